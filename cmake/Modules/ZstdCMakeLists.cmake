@@ -0,0 +1,23 @@
+ExternalProject_Add(zstd
+   PREFIX ${CMAKE_BINARY_DIR}/third_party/build/zstd
+   GIT_REPOSITORY https://github.com/facebook/zstd
+   GIT_TAG v1.4.4
+   # zstd keeps its CMake build in a subdirectory of the repo.
+   CONFIGURE_COMMAND ${CMAKE_COMMAND} <SOURCE_DIR>/build/cmake
+                     -DCMAKE_INSTALL_PREFIX=<INSTALL_DIR>
+                     -DCMAKE_INSTALL_LIBDIR=lib
+                     -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
+                     -DZSTD_BUILD_PROGRAMS=OFF
+                     -DZSTD_BUILD_SHARED=OFF
+   INSTALL_DIR ${CMAKE_BINARY_DIR}/third_party/zstd
+   # Update command has to be set to "", otherwise CMake will refetch
+   # & rebuild every time.
+   UPDATE_COMMAND ""
+)
+
+ExternalProject_Get_Property(zstd install_dir)
+INCLUDE_DIRECTORIES (${install_dir}/include)
+
+ADD_LIBRARY(libzstd STATIC IMPORTED)
+SET_PROPERTY(TARGET libzstd PROPERTY IMPORTED_LOCATION ${CMAKE_BINARY_DIR}/third_party/zstd/lib/libzstd.a)
+ADD_DEPENDENCIES(libzstd zstd)
@@ -1,17 +1,32 @@
 #include <parquet-file/parquet-file.h>
 #include <glog/logging.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <memory>
+
+using parquet_file::FileSink;
 using parquet_file::ParquetColumn;
 using parquet_file::ParquetFile;
+using parquet_file::ParquetSink;
+using parquet_file::StreamSink;
 
 int main(int argc, char* argv[]) {
   if (argc < 3) {
-    printf("Specify filename and number of items:\n\n\t%s <output file> <NNN>\n\n", argv[0]);
+    printf("Specify filename (- for stdout) and number of items:\n\n\t%s <output file> <NNN>\n\n", argv[0]);
     return 1;
   }
   google::InitGoogleLogging(argv[0]);
 
-  ParquetFile output(argv[1]);
+  // Writing to stdout lets the file be piped straight into another
+  // program, e.g. a compressor or ssh.
+  std::unique_ptr<ParquetSink> sink;
+  if (strcmp(argv[1], "-") == 0) {
+    sink.reset(new StreamSink(STDOUT_FILENO));
+  } else {
+    sink.reset(new FileSink(argv[1]));
+  }
+  ParquetFile output(sink.get());
 
   ParquetColumn* one_column =
     new ParquetColumn({"AllInts"}, parquet::Type::INT32,
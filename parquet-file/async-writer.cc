@@ -0,0 +1,238 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./async-writer.h"
+
+#include <errno.h>
+#include <glog/logging.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace parquet_file {
+
+AsyncWriter::AsyncWriter(PositionedWriter* writer, int num_buffers,
+                         int queue_depth)
+  : writer_(writer),
+    queue_depth_(queue_depth),
+    buffers_(num_buffers),
+    writes_in_flight_(0),
+    failed_(false),
+    shutting_down_(false),
+    using_io_uring_(false) {
+  CHECK_NOTNULL(writer);
+  CHECK_GT(num_buffers, 0) << "Need at least one output buffer";
+  CHECK_GT(queue_depth, 0) << "Need a queue depth of at least one";
+  for (int i = 0; i < num_buffers; ++i) {
+    free_buffers_.push_back(i);
+  }
+  using_io_uring_ = InitIoUring(queue_depth);
+  if (!using_io_uring_) {
+    for (int i = 0; i < queue_depth; ++i) {
+      threads_.push_back(std::thread(&AsyncWriter::WriterThread, this));
+    }
+  }
+  VLOG(2) << "Asynchronous output with " << num_buffers << " buffers and "
+          << "queue depth " << queue_depth << " using "
+          << (using_io_uring_ ? "io_uring" : "writer threads");
+}
+
+AsyncWriter::~AsyncWriter() {
+  if (using_io_uring_) {
+#ifdef HAVE_LIBURING
+    while (writes_in_flight_ > 0) {
+      ReapIoUringCompletion();
+    }
+    io_uring_queue_exit(&ring_);
+#endif
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  buffer_queued_.notify_all();
+  for (std::thread& t : threads_) {
+    t.join();
+  }
+}
+
+void AsyncWriter::WriteAt(off_t offset, const vector<struct iovec>& iovecs) {
+  int index = AcquireBuffer();
+  Buffer& buffer = buffers_[index];
+  size_t length = 0;
+  for (const struct iovec& iov : iovecs) {
+    length += iov.iov_len;
+  }
+  // Buffers keep their memory, so once they've grown to the size of a
+  // row group there's no more allocation.
+  if (buffer.data.size() < length) {
+    buffer.data.resize(length);
+  }
+  uint8_t* dest = buffer.data.data();
+  for (const struct iovec& iov : iovecs) {
+    memcpy(dest, iov.iov_base, iov.iov_len);
+    dest += iov.iov_len;
+  }
+  buffer.offset = offset;
+  buffer.length = length;
+  buffer.written = 0;
+  VLOG(2) << "Queueing asynchronous write of " << length
+          << " bytes at offset " << offset;
+
+  if (using_io_uring_) {
+    ++writes_in_flight_;
+    SubmitIoUringWrite(index);
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++writes_in_flight_;
+    queued_buffers_.push_back(index);
+  }
+  buffer_queued_.notify_one();
+}
+
+void AsyncWriter::WaitForCompletions() {
+  if (using_io_uring_) {
+    while (writes_in_flight_ > 0) {
+      ReapIoUringCompletion();
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_done_.wait(lock, [this] () { return writes_in_flight_ == 0; });
+  }
+  LOG_IF(FATAL, failed_) << "An asynchronous write failed";
+}
+
+int AsyncWriter::AcquireBuffer() {
+  if (using_io_uring_) {
+    // Only this thread touches the ring, so completions are reaped
+    // here until both a buffer and a slot in the queue are free.
+    while (free_buffers_.empty() || writes_in_flight_ >= queue_depth_) {
+      ReapIoUringCompletion();
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_done_.wait(lock, [this] () { return !free_buffers_.empty(); });
+  }
+  // Free buffers are only taken on this thread, so the one found
+  // above is still there.
+  std::unique_lock<std::mutex> lock(mutex_);
+  int index = free_buffers_.back();
+  free_buffers_.pop_back();
+  return index;
+}
+
+void AsyncWriter::ReleaseBuffer(int index, bool ok) {
+  if (!ok) {
+    failed_ = true;
+  }
+  free_buffers_.push_back(index);
+  --writes_in_flight_;
+}
+
+void AsyncWriter::WriterThread() {
+  for (;;) {
+    int index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      buffer_queued_.wait(lock, [this] () {
+          return shutting_down_ || !queued_buffers_.empty();
+        });
+      if (queued_buffers_.empty()) {
+        return;
+      }
+      index = queued_buffers_.front();
+      queued_buffers_.pop_front();
+    }
+    Buffer& buffer = buffers_[index];
+    vector<struct iovec> iovecs(1);
+    iovecs[0].iov_base = buffer.data.data();
+    iovecs[0].iov_len = buffer.length;
+    ssize_t written = writer_->WriteAt(buffer.offset, &iovecs);
+    LOG_IF(ERROR, written != buffer.length)
+        << "Asynchronous write at offset " << buffer.offset << " wrote "
+        << written << "/" << buffer.length << " bytes";
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ReleaseBuffer(index, written == buffer.length);
+    }
+    buffer_done_.notify_all();
+  }
+}
+
+#ifdef HAVE_LIBURING
+
+bool AsyncWriter::InitIoUring(int queue_depth) {
+  int ret = io_uring_queue_init(queue_depth, &ring_, 0);
+  if (ret < 0) {
+    LOG(WARNING) << "io_uring unavailable, using writer threads: "
+                 << strerror(-ret);
+    return false;
+  }
+  return true;
+}
+
+void AsyncWriter::SubmitIoUringWrite(int index) {
+  Buffer& buffer = buffers_[index];
+  struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+  // There are never more writes in flight than entries in the ring.
+  CHECK_NOTNULL(sqe);
+  io_uring_prep_write(sqe, writer_->fd(), buffer.data.data() + buffer.written,
+                      buffer.length - buffer.written,
+                      writer_->StartOffset() + buffer.offset +
+                      buffer.written);
+  io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(intptr_t(index)));
+  int ret = io_uring_submit(&ring_);
+  LOG_IF(FATAL, ret < 0) << "io_uring_submit failed: " << strerror(-ret);
+}
+
+void AsyncWriter::ReapIoUringCompletion() {
+  struct io_uring_cqe* cqe;
+  int ret;
+  do {
+    ret = io_uring_wait_cqe(&ring_, &cqe);
+  } while (ret == -EINTR);
+  LOG_IF(FATAL, ret < 0) << "io_uring_wait_cqe failed: " << strerror(-ret);
+  int index = intptr_t(io_uring_cqe_get_data(cqe));
+  int result = cqe->res;
+  io_uring_cqe_seen(&ring_, cqe);
+
+  Buffer& buffer = buffers_[index];
+  if (result == -EINTR || result == -EAGAIN) {
+    SubmitIoUringWrite(index);
+    return;
+  }
+  if (result <= 0) {
+    LOG(ERROR) << "Asynchronous write at offset " << buffer.offset
+               << " failed: " << strerror(-result);
+    std::unique_lock<std::mutex> lock(mutex_);
+    ReleaseBuffer(index, false);
+    return;
+  }
+  buffer.written += result;
+  if (buffer.written < buffer.length) {
+    // Short write; queue the rest.
+    SubmitIoUringWrite(index);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  ReleaseBuffer(index, true);
+}
+
+#else
+
+bool AsyncWriter::InitIoUring(int) {
+  return false;
+}
+
+void AsyncWriter::SubmitIoUringWrite(int) {
+  LOG(FATAL) << "Built without io_uring support";
+}
+
+void AsyncWriter::ReapIoUringCompletion() {
+  LOG(FATAL) << "Built without io_uring support";
+}
+
+#endif  // HAVE_LIBURING
+
+}  // namespace parquet_file
@@ -0,0 +1,113 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <parquet-file/positioned-writer.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef PARQUET_FILE_ASYNC_WRITER_H_
+#define PARQUET_FILE_ASYNC_WRITER_H_
+
+using std::vector;
+
+namespace parquet_file {
+
+// Default number of output buffers, i.e. double buffering.
+const int kDefaultAsyncOutputBuffers = 2;
+// Default number of writes the kernel (or the writer threads) work
+// on at once.
+const int kDefaultAsyncQueueDepth = 4;
+
+// AsyncWriter writes to the file of a PositionedWriter without making
+// the caller wait for the writes.  WriteAt() copies the data into one
+// of a fixed number of output buffers and queues a write of it, so the
+// caller can go on to produce the next row group while the last one is
+// still being written.  The caller only blocks when every buffer is
+// in use.
+//
+// When built with io_uring support (the PARQUET_USE_IO_URING CMake
+// option, which defines HAVE_LIBURING) and the kernel supports it,
+// writes are submitted to an io_uring.  Otherwise they're done with
+// pwritev on queue_depth background threads.
+//
+// WriteAt() and WaitForCompletions() must be called from one thread.
+class AsyncWriter {
+ public:
+  // Queues writes to writer's file using num_buffers output buffers,
+  // with at most queue_depth writes in flight at once.
+  AsyncWriter(PositionedWriter* writer, int num_buffers, int queue_depth);
+  // Waits for queued writes to finish.
+  ~AsyncWriter();
+
+  // Copies the data in iovecs and queues a write of it at offset, a
+  // range the caller has reserved from the PositionedWriter.  Returns
+  // once the data is copied.
+  void WriteAt(off_t offset, const vector<struct iovec>& iovecs);
+
+  // Waits for every queued write to finish.  Dies if any of them
+  // failed.
+  void WaitForCompletions();
+
+  // True if writes go through io_uring rather than writer threads.
+  bool UsingIoUring() const { return using_io_uring_; }
+
+ private:
+  struct Buffer {
+    vector<uint8_t> data;
+    // Where the data goes in the file.
+    off_t offset;
+    size_t length;
+    // Bytes written so far.
+    size_t written;
+  };
+
+  // Returns the index of a buffer that no write is using, waiting for
+  // one to finish if necessary.
+  int AcquireBuffer();
+  // Returns buffer index to the free list once its write is done.
+  // Must be called with mutex_ held.
+  void ReleaseBuffer(int index, bool ok);
+
+  // Loop run by each writer thread when io_uring isn't used.
+  void WriterThread();
+
+  // Sets up ring_, returning false if io_uring can't be used.
+  bool InitIoUring(int queue_depth);
+  // Submits a write of the unwritten part of buffer index.
+  void SubmitIoUringWrite(int index);
+  // Waits for one completion and handles it, resubmitting short
+  // writes.
+  void ReapIoUringCompletion();
+
+  PositionedWriter* writer_;
+  int queue_depth_;
+  vector<Buffer> buffers_;
+  vector<int> free_buffers_;
+  int writes_in_flight_;
+  bool failed_;
+
+  // Used by the writer threads.
+  std::mutex mutex_;
+  std::condition_variable buffer_done_;
+  std::condition_variable buffer_queued_;
+  std::deque<int> queued_buffers_;
+  bool shutting_down_;
+  vector<std::thread> threads_;
+
+  bool using_io_uring_;
+#ifdef HAVE_LIBURING
+  struct io_uring ring_;
+#endif
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_ASYNC_WRITER_H_
@@ -0,0 +1,185 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./bloom-filter.h"
+
+#include <glog/logging.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+namespace {
+
+const int kWordsPerBlock = 8;
+
+// Odd constants the format uses to pick a bit in each word of a
+// block.
+const uint32_t kSalt[kWordsPerBlock] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+// xxHash64 primes.
+const uint64_t kPrime1 = 11400714785074694791ULL;
+const uint64_t kPrime2 = 14029467366897019727ULL;
+const uint64_t kPrime3 = 1609587929392839161ULL;
+const uint64_t kPrime4 = 9650029242287828579ULL;
+const uint64_t kPrime5 = 2870177450012600261ULL;
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t Read64(const uint8_t* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline uint32_t Read32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline uint64_t Round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * kPrime2;
+  accumulator = RotateLeft(accumulator, 31);
+  return accumulator * kPrime1;
+}
+
+// Index of the first word of the block hash picks, out of num_blocks.
+// The top half of the hash picks the block, without a division.
+inline size_t BlockOffset(uint64_t hash, uint64_t num_blocks) {
+  return ((hash >> 32) * num_blocks >> 32) * kWordsPerBlock;
+}
+
+// The bit hash sets in word i of its block.
+inline uint32_t BlockBit(uint64_t hash, int i) {
+  uint32_t key = static_cast<uint32_t>(hash);
+  return 1U << ((key * kSalt[i]) >> 27);
+}
+
+inline uint64_t MergeRound(uint64_t hash, uint64_t accumulator) {
+  hash ^= Round(0, accumulator);
+  return hash * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+BloomFilter::BloomFilter(uint32_t num_bytes) {
+  LOG_IF(FATAL, !IsValidNumBytes(num_bytes))
+      << "Invalid Bloom filter size: " << num_bytes << " bytes";
+  blocks_.resize(num_bytes / sizeof(uint32_t));
+}
+
+BloomFilter::BloomFilter(const uint8_t* bitset, uint32_t num_bytes)
+  : BloomFilter(num_bytes) {
+  memcpy(blocks_.data(), bitset, num_bytes);
+}
+
+// static
+bool BloomFilter::IsValidNumBytes(uint32_t num_bytes) {
+  return num_bytes >= kMinBloomFilterBytes &&
+      num_bytes <= kMaxBloomFilterBytes && (num_bytes & (num_bytes - 1)) == 0;
+}
+
+// static
+uint32_t BloomFilter::OptimalNumBytes(uint64_t num_distinct_values,
+                                      double fpp) {
+  CHECK(fpp > 0.0 && fpp < 1.0) << "Invalid false positive probability "
+                                << fpp;
+  // From the format's description of the split block filter: with k
+  // = 8 bits set per value, m bits give a false positive probability
+  // of (1 - e^(-8n/m))^8.
+  double num_bits =
+      -8.0 * num_distinct_values / log(1.0 - pow(fpp, 1.0 / 8));
+  uint32_t num_bytes = kMinBloomFilterBytes;
+  while (num_bytes < kMaxBloomFilterBytes && num_bytes * 8.0 < num_bits) {
+    num_bytes *= 2;
+  }
+  return num_bytes;
+}
+
+// static
+uint64_t BloomFilter::Hash(const uint8_t* data, size_t length) {
+  const uint8_t* end = data + length;
+  uint64_t hash;
+  if (length >= 32) {
+    uint64_t v1 = kPrime1 + kPrime2;
+    uint64_t v2 = kPrime2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -kPrime1;
+    for (; data + 32 <= end; data += 32) {
+      v1 = Round(v1, Read64(data));
+      v2 = Round(v2, Read64(data + 8));
+      v3 = Round(v3, Read64(data + 16));
+      v4 = Round(v4, Read64(data + 24));
+    }
+    hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) +
+        RotateLeft(v4, 18);
+    hash = MergeRound(hash, v1);
+    hash = MergeRound(hash, v2);
+    hash = MergeRound(hash, v3);
+    hash = MergeRound(hash, v4);
+  } else {
+    hash = kPrime5;
+  }
+  hash += length;
+  for (; data + 8 <= end; data += 8) {
+    hash ^= Round(0, Read64(data));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (data + 4 <= end) {
+    hash ^= Read32(data) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    data += 4;
+  }
+  for (; data < end; ++data) {
+    hash ^= *data * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+  }
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+void BloomFilter::Insert(uint64_t hash) {
+  uint32_t* block =
+      &blocks_[BlockOffset(hash, blocks_.size() / kWordsPerBlock)];
+  for (int i = 0; i < kWordsPerBlock; ++i) {
+    block[i] |= BlockBit(hash, i);
+  }
+}
+
+bool BloomFilter::MightContain(uint64_t hash) const {
+  return BloomFilterView(Bitset(), NumBytes()).MightContain(hash);
+}
+
+void BloomFilter::Clear() {
+  std::fill(blocks_.begin(), blocks_.end(), 0);
+}
+
+BloomFilterView::BloomFilterView(const uint8_t* bitset, uint32_t num_bytes)
+  : bitset_(bitset),
+    num_blocks_(num_bytes / (kWordsPerBlock * sizeof(uint32_t))) {
+  DCHECK(BloomFilter::IsValidNumBytes(num_bytes));
+}
+
+bool BloomFilterView::MightContain(uint64_t hash) const {
+  const uint8_t* block =
+      bitset_ + BlockOffset(hash, num_blocks_) * sizeof(uint32_t);
+  for (int i = 0; i < kWordsPerBlock; ++i) {
+    if ((Read32(block + i * sizeof(uint32_t)) & BlockBit(hash, i)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace parquet_file
@@ -0,0 +1,87 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#ifndef PARQUET_FILE_BLOOM_FILTER_H_
+#define PARQUET_FILE_BLOOM_FILTER_H_
+
+using std::vector;
+
+namespace parquet_file {
+
+// False positive probability a column's Bloom filter is sized for
+// unless another is given.
+const double kDefaultBloomFilterFpp = 0.01;
+// Limits on the size of a Bloom filter's bitset, in bytes.
+const uint32_t kMinBloomFilterBytes = 32;
+const uint32_t kMaxBloomFilterBytes = 128 * 1024 * 1024;
+
+// A split block Bloom filter, as the Parquet format defines it: the
+// bitset is made of 256-bit blocks, and each value sets one bit in
+// each of the eight 32-bit words of the block its hash picks.  Values
+// are hashed with xxHash64 of their PLAIN encoding (without the length
+// of byte arrays).
+class BloomFilter {
+ public:
+  // An empty filter of num_bytes, which must be a power of two
+  // between kMinBloomFilterBytes and kMaxBloomFilterBytes.
+  explicit BloomFilter(uint32_t num_bytes);
+  // A filter with a copy of the num_bytes bitset at bitset, e.g. read
+  // from a file.
+  BloomFilter(const uint8_t* bitset, uint32_t num_bytes);
+
+  // Size in bytes of a filter that holds num_distinct_values with a
+  // false positive probability of at most fpp, rounded up to a power
+  // of two and clamped to the limits above.
+  static uint32_t OptimalNumBytes(uint64_t num_distinct_values, double fpp);
+
+  // xxHash64, with a seed of 0, of the length bytes at data.
+  static uint64_t Hash(const uint8_t* data, size_t length);
+
+  void Insert(uint64_t hash);
+  // False if a value with hash was definitely never inserted.
+  bool MightContain(uint64_t hash) const;
+
+  // Clears every bit.
+  void Clear();
+
+  // True if num_bytes is a valid bitset size: a power of two between
+  // kMinBloomFilterBytes and kMaxBloomFilterBytes.
+  static bool IsValidNumBytes(uint32_t num_bytes);
+
+  // The bitset, as it's written to the file.
+  const uint8_t* Bitset() const {
+    return reinterpret_cast<const uint8_t*>(blocks_.data());
+  }
+  uint32_t NumBytes() const { return blocks_.size() * sizeof(blocks_[0]); }
+
+ private:
+  // The blocks, eight words each, back to back.  Words are stored in
+  // host order, which is the file's little endian order on the
+  // machines we run on.
+  vector<uint32_t> blocks_;
+};
+
+// A split block Bloom filter probed in place, without copying its
+// bitset, e.g. one in a mapped file.  The bitset needn't be aligned,
+// and must outlive the view.
+class BloomFilterView {
+ public:
+  // The num_bytes bitset at bitset, which must be a valid size for a
+  // BloomFilter.
+  BloomFilterView(const uint8_t* bitset, uint32_t num_bytes);
+
+  // False if a value with hash was definitely never inserted.
+  bool MightContain(uint64_t hash) const;
+
+ private:
+  const uint8_t* bitset_;
+  uint32_t num_blocks_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_BLOOM_FILTER_H_
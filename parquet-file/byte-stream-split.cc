@@ -0,0 +1,87 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./byte-stream-split.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace parquet_file {
+
+namespace {
+
+// Number of values each SIMD transpose handles.
+const size_t kValuesPerBlock = 16;
+
+#ifdef __SSE2__
+// Interleaves the first and second halves of the WIDTH registers in
+// input, a byte at a time, into output.  The loops here are short and
+// fixed, but -O2 won't unroll them on its own, and unrolling is what
+// keeps the block in registers.
+template <int WIDTH>
+inline void InterleaveHalves(const __m128i* input, __m128i* output) {
+#pragma GCC unroll 8
+  for (int j = 0; j < WIDTH / 2; ++j) {
+    output[2 * j] = _mm_unpacklo_epi8(input[j], input[j + WIDTH / 2]);
+    output[2 * j + 1] = _mm_unpackhi_epi8(input[j], input[j + WIDTH / 2]);
+  }
+}
+
+// Transposes 16 values of WIDTH bytes, held in WIDTH registers, so
+// register b ends up holding byte b of each value.  The block is a
+// 16 x WIDTH byte matrix; interleaving its halves rotates each byte's
+// index in it left by a bit, and four rotations move the value's
+// index from the high bits to the low bits.
+template <int WIDTH>
+void SplitBlock(const uint8_t* values, size_t stream_length,
+                uint8_t* streams) {
+  __m128i block[WIDTH], interleaved[WIDTH];
+#pragma GCC unroll 8
+  for (int j = 0; j < WIDTH; ++j) {
+    block[j] = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(values + j * 16));
+  }
+  InterleaveHalves<WIDTH>(block, interleaved);
+  InterleaveHalves<WIDTH>(interleaved, block);
+  InterleaveHalves<WIDTH>(block, interleaved);
+  InterleaveHalves<WIDTH>(interleaved, block);
+#pragma GCC unroll 8
+  for (int b = 0; b < WIDTH; ++b) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(streams + b * stream_length),
+                     block[b]);
+  }
+}
+#endif
+
+// Handles whole blocks of 16 values with SplitBlock, if it's
+// available, and returns how many values it did.
+template <int WIDTH>
+size_t SplitBlocks(const uint8_t* values, size_t num_values,
+                   size_t stream_length, uint8_t* streams) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + kValuesPerBlock <= num_values; i += kValuesPerBlock) {
+    SplitBlock<WIDTH>(values + i * WIDTH, stream_length, streams + i);
+  }
+#endif
+  return i;
+}
+
+}  // namespace
+
+void SplitByteStreams(const uint8_t* values, size_t num_values, int width,
+                      size_t stream_length, uint8_t* streams) {
+  size_t i = 0;
+  if (width == 4) {
+    i = SplitBlocks<4>(values, num_values, stream_length, streams);
+  } else if (width == 8) {
+    i = SplitBlocks<8>(values, num_values, stream_length, streams);
+  }
+  for (; i < num_values; ++i) {
+    for (int b = 0; b < width; ++b) {
+      streams[b * stream_length + i] = values[i * width + b];
+    }
+  }
+}
+
+}  // namespace parquet_file
@@ -0,0 +1,27 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef PARQUET_FILE_BYTE_STREAM_SPLIT_H_
+#define PARQUET_FILE_BYTE_STREAM_SPLIT_H_
+
+namespace parquet_file {
+
+// BYTE_STREAM_SPLIT encodes values of width bytes as width streams:
+// the first byte of every value, then the second byte of every value,
+// and so on.  It's no smaller itself, but the bytes of floating point
+// values that change slowly (signs, exponents, high mantissa bits) end
+// up next to each other, where a compression codec can find them.
+//
+// Scatters byte b of value i of the num_values values at values to
+// streams[b * stream_length + i].  stream_length is the number of
+// values in the whole page, so values can be encoded in pieces by
+// offsetting streams by the number of values before each piece.
+// Widths 4 and 8 transpose 16 values at a time with SSE2.
+void SplitByteStreams(const uint8_t* values, size_t num_values, int width,
+                      size_t stream_length, uint8_t* streams);
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_BYTE_STREAM_SPLIT_H_
@@ -0,0 +1,145 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./chunked-buffer.h"
+
+#include <errno.h>
+#include <glog/logging.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+ChunkedBuffer::ChunkedBuffer()
+  : current_chunk_(0),
+    next_chunk_size_(kMinBufferChunkSizeInBytes),
+    size_(0) {
+}
+
+void ChunkedBuffer::AddChunk(boost::shared_array<uint8_t> buffer,
+                             size_t size_in_bytes) {
+  CHECK_NOTNULL(buffer.get());
+  Chunk c;
+  c.data = buffer;
+  c.capacity = size_in_bytes;
+  c.used = 0;
+  chunks_.push_back(c);
+}
+
+void ChunkedBuffer::AddNewChunk(size_t min_size) {
+  size_t chunk_size = std::max(next_chunk_size_, min_size);
+  VLOG(3) << "Allocating buffer chunk of " << chunk_size << " bytes";
+  Chunk c;
+  c.data.reset(new uint8_t[chunk_size]);
+  c.capacity = chunk_size;
+  c.used = 0;
+  chunks_.push_back(c);
+  next_chunk_size_ = std::min(next_chunk_size_ * 2, kMaxBufferChunkSizeInBytes);
+}
+
+size_t ChunkedBuffer::BytesAvailableInCurrentChunk() const {
+  if (current_chunk_ >= chunks_.size()) {
+    return 0;
+  }
+  const Chunk& c = chunks_[current_chunk_];
+  return c.capacity - c.used;
+}
+
+uint8_t* ChunkedBuffer::Allocate(size_t num_bytes) {
+  // Move down the chain until we find a chunk with enough room.  Any
+  // chunk we skip over is left partially filled.
+  while (current_chunk_ < chunks_.size() &&
+         BytesAvailableInCurrentChunk() < num_bytes) {
+    ++current_chunk_;
+  }
+  if (current_chunk_ >= chunks_.size()) {
+    AddNewChunk(num_bytes);
+    current_chunk_ = chunks_.size() - 1;
+  }
+  Chunk& c = chunks_[current_chunk_];
+  uint8_t* ptr = c.data.get() + c.used;
+  c.used += num_bytes;
+  size_ += num_bytes;
+  return ptr;
+}
+
+uint8_t* ChunkedBuffer::Append(const void* data, size_t num_bytes) {
+  uint8_t* ptr = Allocate(num_bytes);
+  memcpy(ptr, data, num_bytes);
+  return ptr;
+}
+
+void ChunkedBuffer::GetIovecs(size_t offset, size_t length,
+                              vector<struct iovec>* iovecs) const {
+  CHECK_NOTNULL(iovecs);
+  CHECK_LE(offset + length, size_) << "Range is past the end of the buffer";
+  for (const Chunk& c : chunks_) {
+    if (length == 0) {
+      break;
+    }
+    if (offset >= c.used) {
+      offset -= c.used;
+      continue;
+    }
+    struct iovec iov;
+    iov.iov_base = c.data.get() + offset;
+    iov.iov_len = std::min(c.used - offset, length);
+    iovecs->push_back(iov);
+    length -= iov.iov_len;
+    offset = 0;
+  }
+}
+
+void ChunkedBuffer::CopyTo(size_t offset, size_t length, uint8_t* dest) const {
+  vector<struct iovec> iovecs;
+  GetIovecs(offset, length, &iovecs);
+  for (const struct iovec& iov : iovecs) {
+    memcpy(dest, iov.iov_base, iov.iov_len);
+    dest += iov.iov_len;
+  }
+}
+
+void ChunkedBuffer::Clear() {
+  if (chunks_.size() > 1) {
+    chunks_.resize(1);
+  }
+  if (chunks_.size() == 1) {
+    chunks_[0].used = 0;
+  }
+  current_chunk_ = 0;
+  size_ = 0;
+}
+
+ssize_t WriteIovecs(int fd, vector<struct iovec>* iovecs) {
+  CHECK_NOTNULL(iovecs);
+  size_t total_written = 0;
+  size_t first = 0;
+  while (first < iovecs->size()) {
+    int count = std::min<size_t>(iovecs->size() - first, IOV_MAX);
+    ssize_t written = writev(fd, &(*iovecs)[first], count);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(ERROR) << "writev failed: " << strerror(errno);
+      return -1;
+    }
+    total_written += written;
+    // Skip past the iovecs that were written completely, and adjust
+    // the first one that was only partially written.
+    while (first < iovecs->size() && written >= (*iovecs)[first].iov_len) {
+      written -= (*iovecs)[first].iov_len;
+      ++first;
+    }
+    if (written > 0) {
+      struct iovec& partial = (*iovecs)[first];
+      partial.iov_base = (uint8_t*)partial.iov_base + written;
+      partial.iov_len -= written;
+    }
+  }
+  return total_written;
+}
+
+}  // namespace parquet_file
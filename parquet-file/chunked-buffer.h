@@ -0,0 +1,90 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <boost/shared_array.hpp>
+#include <sys/uio.h>
+
+#include <vector>
+
+#ifndef PARQUET_FILE_CHUNKED_BUFFER_H_
+#define PARQUET_FILE_CHUNKED_BUFFER_H_
+
+using std::vector;
+
+namespace parquet_file {
+
+// Size of the first chunk allocated by a ChunkedBuffer.  Chunk sizes
+// double from here up to kMaxBufferChunkSizeInBytes, so that narrow
+// columns don't pay for a large allocation up front.
+const size_t kMinBufferChunkSizeInBytes = 64 * 1024;
+const size_t kMaxBufferChunkSizeInBytes = 16 * 1024 * 1024;
+
+// ChunkedBuffer is a growable byte buffer made up of a chain of
+// chunks.  Data that has been appended is never moved, so pointers
+// returned by Allocate() or Append() remain valid until Clear() is
+// called or the buffer is destroyed.  Every allocation is contiguous:
+// if it doesn't fit in what is left of the current chunk, a new chunk
+// is started and the tail of the old one is left unused.
+class ChunkedBuffer {
+ public:
+  ChunkedBuffer();
+
+  // Adds a caller-provided buffer of size_in_bytes to the end of the
+  // chain.  Subsequent allocations are served from it before any new
+  // chunk is allocated.
+  void AddChunk(boost::shared_array<uint8_t> buffer, size_t size_in_bytes);
+
+  // Returns a pointer to num_bytes of contiguous storage at the end
+  // of the buffer.  The storage is counted as used.
+  uint8_t* Allocate(size_t num_bytes);
+
+  // Copies num_bytes from data to the end of the buffer and returns
+  // a pointer to where they were copied.
+  uint8_t* Append(const void* data, size_t num_bytes);
+
+  // Number of bytes that can be allocated without starting a new
+  // chunk.
+  size_t BytesAvailableInCurrentChunk() const;
+
+  // Number of bytes of data in the buffer.
+  size_t Size() const { return size_; }
+
+  // Appends iovecs covering length bytes of data, starting offset
+  // bytes into the buffer.  Offsets count data only, not the unused
+  // tails of chunks.
+  void GetIovecs(size_t offset, size_t length,
+                 vector<struct iovec>* iovecs) const;
+
+  // Copies length bytes of data, starting offset bytes into the
+  // buffer, to dest.
+  void CopyTo(size_t offset, size_t length, uint8_t* dest) const;
+
+  // Discards all data.  The first chunk is kept for reuse; the rest
+  // are released.
+  void Clear();
+
+ private:
+  struct Chunk {
+    boost::shared_array<uint8_t> data;
+    size_t capacity;
+    size_t used;
+  };
+
+  // Allocates a new chunk big enough to hold at least min_size bytes.
+  void AddNewChunk(size_t min_size);
+
+  vector<Chunk> chunks_;
+  // Index into chunks_ of the chunk allocations are served from.
+  size_t current_chunk_;
+  // Size of the next chunk we allocate ourselves.
+  size_t next_chunk_size_;
+  size_t size_;
+};
+
+// Writes all of iovecs to fd, calling writev as many times as it
+// takes.  iovecs is modified along the way.  Returns the number of
+// bytes written, or -1 on error.
+ssize_t WriteIovecs(int fd, vector<struct iovec>* iovecs);
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_CHUNKED_BUFFER_H_
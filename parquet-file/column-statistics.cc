@@ -0,0 +1,416 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./column-statistics.h"
+
+#include <glog/logging.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+namespace parquet_file {
+
+namespace {
+
+// Min/max kernels.  Each sets min and max to the smallest and largest
+// of the n values, and returns false if there are none to compare
+// (n is 0, or every value is a NaN).  The SSE2 loops keep a vector of
+// running mins and maxes and reduce it at the end; the scalar loops
+// pick up whatever is left over.
+
+bool MinMaxInt32(const int32_t* values, uint32_t n,
+                 int32_t* min, int32_t* max) {
+  if (n == 0) {
+    return false;
+  }
+  int32_t lo = values[0];
+  int32_t hi = values[0];
+  uint32_t i = 1;
+#ifdef __SSE2__
+  if (n >= 8) {
+    __m128i vmin = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+    __m128i vmax = vmin;
+    for (i = 4; i + 4 <= n; i += 4) {
+      __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+#ifdef __SSE4_1__
+      vmin = _mm_min_epi32(vmin, v);
+      vmax = _mm_max_epi32(vmax, v);
+#else
+      __m128i less = _mm_cmplt_epi32(v, vmin);
+      vmin = _mm_or_si128(_mm_and_si128(less, v),
+                          _mm_andnot_si128(less, vmin));
+      __m128i greater = _mm_cmpgt_epi32(v, vmax);
+      vmax = _mm_or_si128(_mm_and_si128(greater, v),
+                          _mm_andnot_si128(greater, vmax));
+#endif
+    }
+    int32_t mins[4], maxes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxes), vmax);
+    for (int lane = 0; lane < 4; ++lane) {
+      lo = std::min(lo, mins[lane]);
+      hi = std::max(hi, maxes[lane]);
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    lo = std::min(lo, values[i]);
+    hi = std::max(hi, values[i]);
+  }
+  *min = lo;
+  *max = hi;
+  return true;
+}
+
+// SSE2 has no 64-bit compares, so this relies on the compiler
+// vectorizing the independent accumulators where it can.
+bool MinMaxInt64(const int64_t* values, uint32_t n,
+                 int64_t* min, int64_t* max) {
+  if (n == 0) {
+    return false;
+  }
+  int64_t lo[4] = {values[0], values[0], values[0], values[0]};
+  int64_t hi[4] = {values[0], values[0], values[0], values[0]};
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int lane = 0; lane < 4; ++lane) {
+      lo[lane] = std::min(lo[lane], values[i + lane]);
+      hi[lane] = std::max(hi[lane], values[i + lane]);
+    }
+  }
+  for (; i < n; ++i) {
+    lo[0] = std::min(lo[0], values[i]);
+    hi[0] = std::max(hi[0], values[i]);
+  }
+  *min = *std::min_element(lo, lo + 4);
+  *max = *std::max_element(hi, hi + 4);
+  return true;
+}
+
+// Comparisons with a NaN are false, so starting from +/- infinity
+// and only moving on a successful comparison skips NaNs.  The SSE
+// min/max instructions return their second operand when either is a
+// NaN, which has the same effect with the running value second.
+template <typename T>
+bool MinMaxFloatingScalar(const T* values, uint32_t n, uint32_t i,
+                          T lo, T hi, T* min, T* max) {
+  for (; i < n; ++i) {
+    if (values[i] < lo) {
+      lo = values[i];
+    }
+    if (values[i] > hi) {
+      hi = values[i];
+    }
+  }
+  if (lo > hi) {
+    return false;
+  }
+  *min = lo;
+  *max = hi;
+  return true;
+}
+
+bool MinMaxFloat(const float* values, uint32_t n, float* min, float* max) {
+  float lo = std::numeric_limits<float>::infinity();
+  float hi = -std::numeric_limits<float>::infinity();
+  uint32_t i = 0;
+#ifdef __SSE2__
+  if (n >= 8) {
+    __m128 vmin = _mm_set1_ps(lo);
+    __m128 vmax = _mm_set1_ps(hi);
+    for (; i + 4 <= n; i += 4) {
+      __m128 v = _mm_loadu_ps(values + i);
+      vmin = _mm_min_ps(v, vmin);
+      vmax = _mm_max_ps(v, vmax);
+    }
+    float mins[4], maxes[4];
+    _mm_storeu_ps(mins, vmin);
+    _mm_storeu_ps(maxes, vmax);
+    for (int lane = 0; lane < 4; ++lane) {
+      lo = std::min(lo, mins[lane]);
+      hi = std::max(hi, maxes[lane]);
+    }
+  }
+#endif
+  return MinMaxFloatingScalar(values, n, i, lo, hi, min, max);
+}
+
+bool MinMaxDouble(const double* values, uint32_t n,
+                  double* min, double* max) {
+  double lo = std::numeric_limits<double>::infinity();
+  double hi = -std::numeric_limits<double>::infinity();
+  uint32_t i = 0;
+#ifdef __SSE2__
+  if (n >= 4) {
+    __m128d vmin = _mm_set1_pd(lo);
+    __m128d vmax = _mm_set1_pd(hi);
+    for (; i + 2 <= n; i += 2) {
+      __m128d v = _mm_loadu_pd(values + i);
+      vmin = _mm_min_pd(v, vmin);
+      vmax = _mm_max_pd(v, vmax);
+    }
+    double mins[2], maxes[2];
+    _mm_storeu_pd(mins, vmin);
+    _mm_storeu_pd(maxes, vmax);
+    for (int lane = 0; lane < 2; ++lane) {
+      lo = std::min(lo, mins[lane]);
+      hi = std::max(hi, maxes[lane]);
+    }
+  }
+#endif
+  return MinMaxFloatingScalar(values, n, i, lo, hi, min, max);
+}
+
+bool MinMaxBoolean(const uint8_t* values, uint32_t n,
+                   uint8_t* min, uint8_t* max) {
+  if (n == 0) {
+    return false;
+  }
+  *min = *std::min_element(values, values + n);
+  *max = *std::max_element(values, values + n);
+  return true;
+}
+
+// Compares byte strings as unsigned bytes, a shorter string first
+// when it's a prefix of a longer one.
+int CompareBytes(const uint8_t* a, size_t a_length,
+                 const uint8_t* b, size_t b_length) {
+  int result = memcmp(a, b, std::min(a_length, b_length));
+  if (result != 0) {
+    return result;
+  }
+  return a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+}
+
+template <typename T>
+string EncodeValue(T value) {
+  return string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T DecodeValue(const string& encoded) {
+  T value;
+  memcpy(&value, encoded.data(), sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+ColumnStatistics::ColumnStatistics(Type::type type)
+  : type_(type),
+    has_min_max_(false),
+    null_count_(0) {
+}
+
+void ColumnStatistics::Reset() {
+  has_min_max_ = false;
+  min_.clear();
+  max_.clear();
+  null_count_ = 0;
+}
+
+template <typename T>
+void ColumnStatistics::Fold(T min, T max) {
+  if (!has_min_max_) {
+    min_ = EncodeValue(min);
+    max_ = EncodeValue(max);
+    has_min_max_ = true;
+    return;
+  }
+  if (min < DecodeValue<T>(min_)) {
+    min_ = EncodeValue(min);
+  }
+  if (DecodeValue<T>(max_) < max) {
+    max_ = EncodeValue(max);
+  }
+}
+
+void ColumnStatistics::AddValues(const uint8_t* values, uint32_t n) {
+  switch (type_) {
+    case Type::BOOLEAN: {
+      uint8_t min, max;
+      if (MinMaxBoolean(values, n, &min, &max)) {
+        Fold(min, max);
+      }
+      break;
+    }
+    case Type::INT32: {
+      int32_t min, max;
+      if (MinMaxInt32(reinterpret_cast<const int32_t*>(values), n,
+                      &min, &max)) {
+        Fold(min, max);
+      }
+      break;
+    }
+    case Type::INT64: {
+      int64_t min, max;
+      if (MinMaxInt64(reinterpret_cast<const int64_t*>(values), n,
+                      &min, &max)) {
+        Fold(min, max);
+      }
+      break;
+    }
+    case Type::FLOAT: {
+      float min, max;
+      if (MinMaxFloat(reinterpret_cast<const float*>(values), n,
+                      &min, &max)) {
+        Fold(min, max);
+      }
+      break;
+    }
+    case Type::DOUBLE: {
+      double min, max;
+      if (MinMaxDouble(reinterpret_cast<const double*>(values), n,
+                       &min, &max)) {
+        Fold(min, max);
+      }
+      break;
+    }
+    case Type::INT96:
+      // No sort order, so no min or max.
+      break;
+    default:
+      LOG(FATAL) << "AddValues called for a column of type "
+                 << parquet::_Type_VALUES_TO_NAMES.at(type_);
+  }
+}
+
+void ColumnStatistics::AddByteArray(const uint8_t* value, uint32_t length) {
+  DCHECK_EQ(type_, Type::BYTE_ARRAY);
+  if (!has_min_max_) {
+    min_.assign(reinterpret_cast<const char*>(value), length);
+    max_ = min_;
+    has_min_max_ = true;
+    return;
+  }
+  if (CompareBytes(value, length, reinterpret_cast<const uint8_t*>(
+          min_.data()), min_.size()) < 0) {
+    min_.assign(reinterpret_cast<const char*>(value), length);
+  } else if (CompareBytes(value, length, reinterpret_cast<const uint8_t*>(
+                 max_.data()), max_.size()) > 0) {
+    max_.assign(reinterpret_cast<const char*>(value), length);
+  }
+}
+
+void ColumnStatistics::AddPlainByteArrays(const uint8_t* data,
+                                          size_t length) {
+  const uint8_t* end = data + length;
+  while (data < end) {
+    uint32_t value_length;
+    memcpy(&value_length, data, sizeof(value_length));
+    data += sizeof(value_length);
+    CHECK_LE(data + value_length, end) << "Byte array runs past its buffer";
+    AddByteArray(data, value_length);
+    data += value_length;
+  }
+}
+
+namespace {
+
+template <typename T>
+int CompareDecoded(const string& a, const string& b) {
+  T a_value = DecodeValue<T>(a);
+  T b_value = DecodeValue<T>(b);
+  return a_value < b_value ? -1 : (b_value < a_value ? 1 : 0);
+}
+
+}  // namespace
+
+// static
+int ColumnStatistics::Compare(Type::type type, const string& a,
+                              const string& b) {
+  switch (type) {
+    case Type::BOOLEAN:
+      return CompareDecoded<uint8_t>(a, b);
+    case Type::INT32:
+      return CompareDecoded<int32_t>(a, b);
+    case Type::INT64:
+      return CompareDecoded<int64_t>(a, b);
+    case Type::FLOAT:
+      return CompareDecoded<float>(a, b);
+    case Type::DOUBLE:
+      return CompareDecoded<double>(a, b);
+    case Type::BYTE_ARRAY:
+      return CompareBytes(reinterpret_cast<const uint8_t*>(a.data()),
+                          a.size(),
+                          reinterpret_cast<const uint8_t*>(b.data()),
+                          b.size());
+    default:
+      LOG(FATAL) << "Values of type " << parquet::_Type_VALUES_TO_NAMES.at(type)
+                 << " have no order";
+      return 0;
+  }
+}
+
+parquet::Statistics ColumnStatistics::ToThrift(int64_t distinct_count) const {
+  parquet::Statistics statistics;
+  statistics.__set_null_count(null_count_);
+  if (distinct_count >= 0) {
+    statistics.__set_distinct_count(distinct_count);
+  }
+  if (!has_min_max_) {
+    return statistics;
+  }
+  string min = min_;
+  string max = max_;
+  switch (type_) {
+    case Type::FLOAT:
+      // A zero min or max could stand for either zero, so write the
+      // one that bounds both.
+      if (DecodeValue<float>(min) == 0.0f) {
+        min = EncodeValue(-0.0f);
+      }
+      if (DecodeValue<float>(max) == 0.0f) {
+        max = EncodeValue(0.0f);
+      }
+      break;
+    case Type::DOUBLE:
+      if (DecodeValue<double>(min) == 0.0) {
+        min = EncodeValue(-0.0);
+      }
+      if (DecodeValue<double>(max) == 0.0) {
+        max = EncodeValue(0.0);
+      }
+      break;
+    case Type::BYTE_ARRAY:
+      if (min.size() > kMaxStatisticsValueLength) {
+        min.resize(kMaxStatisticsValueLength);
+      }
+      if (max.size() > kMaxStatisticsValueLength) {
+        // Round the prefix up by incrementing its last byte that can
+        // be; if they're all 0xff, there's no shorter bound.
+        string truncated = max.substr(0, kMaxStatisticsValueLength);
+        while (!truncated.empty() &&
+               static_cast<uint8_t>(truncated.back()) == 0xff) {
+          truncated.pop_back();
+        }
+        if (!truncated.empty()) {
+          truncated.back() = static_cast<char>(
+              static_cast<uint8_t>(truncated.back()) + 1);
+          max = truncated;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  statistics.__set_min_value(min);
+  statistics.__set_max_value(max);
+  if (type_ != Type::BYTE_ARRAY) {
+    // Older readers only know the deprecated fields, whose signed
+    // order is right for everything but byte arrays.
+    statistics.__set_min(min);
+    statistics.__set_max(max);
+  }
+  return statistics;
+}
+
+}  // namespace parquet_file
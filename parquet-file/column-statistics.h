@@ -0,0 +1,72 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include "./parquet_types.h"
+#include <stdint.h>
+
+#include <string>
+
+#ifndef PARQUET_FILE_COLUMN_STATISTICS_H_
+#define PARQUET_FILE_COLUMN_STATISTICS_H_
+
+using parquet::Type;
+using std::string;
+
+namespace parquet_file {
+
+// Longest BYTE_ARRAY min or max, in bytes, written to a Statistics.
+// Longer ones are truncated, and a truncated max is rounded up so it
+// still bounds the values.
+const uint32_t kMaxStatisticsValueLength = 64;
+
+// Running min, max and null count of the values of a column chunk or
+// data page.  Values are given in their PLAIN encoding.  Integers and
+// floating point values are compared as signed, and byte arrays as
+// unsigned bytes, which is the Parquet sort order for unannotated
+// columns.  NaNs are left out of the min and max, and INT96 values,
+// which have no order, only count towards nulls.
+class ColumnStatistics {
+ public:
+  explicit ColumnStatistics(Type::type type);
+
+  // Adds n fixed-width values, packed back to back.
+  void AddValues(const uint8_t* values, uint32_t n);
+  // Adds one BYTE_ARRAY value of length bytes.
+  void AddByteArray(const uint8_t* value, uint32_t length);
+  // Adds the PLAIN encoded BYTE_ARRAY values (each a 4-byte length
+  // followed by its bytes) that make up the length bytes at data.
+  void AddPlainByteArrays(const uint8_t* data, size_t length);
+  void AddNulls(uint64_t n) { null_count_ += n; }
+
+  // Forgets everything added so far.
+  void Reset();
+
+  bool HasMinMax() const { return has_min_max_; }
+  uint64_t NullCount() const { return null_count_; }
+
+  // Compares a and b, PLAIN encoded values of type as they appear in
+  // Statistics, in the order described above.  Returns a negative
+  // number, zero or a positive number, like memcmp.
+  static int Compare(Type::type type, const string& a, const string& b);
+
+  // Returns the statistics as Parquet metadata.  distinct_count is
+  // only set if it isn't negative.
+  parquet::Statistics ToThrift(int64_t distinct_count = -1) const;
+
+ private:
+  // Widens the min and max to include min and max, values of the
+  // column's fixed-width type.
+  template <typename T>
+  void Fold(T min, T max);
+
+  Type::type type_;
+  bool has_min_max_;
+  // PLAIN encoded min and max, without the length prefix of byte
+  // arrays.
+  string min_;
+  string max_;
+  uint64_t null_count_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_COLUMN_STATISTICS_H_
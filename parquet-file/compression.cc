@@ -0,0 +1,144 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./compression.h"
+
+#include <glog/logging.h>
+#include <snappy.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace parquet_file {
+
+namespace {
+
+void SnappyCompress(const uint8_t* input, size_t input_length,
+                    vector<uint8_t>* output) {
+  output->resize(snappy::MaxCompressedLength(input_length));
+  size_t compressed_length;
+  snappy::RawCompress((const char*)input, input_length,
+                      (char*)output->data(), &compressed_length);
+  output->resize(compressed_length);
+}
+
+// Parquet's GZIP codec is deflate with a gzip header & trailer, which
+// zlib produces when 16 is added to the window bits.
+void GzipCompress(int level, const uint8_t* input, size_t input_length,
+                  vector<uint8_t>* output) {
+  if (level == kCodecDefaultCompressionLevel) {
+    level = Z_DEFAULT_COMPRESSION;
+  }
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  int ret = deflateInit2(&stream, level, Z_DEFLATED, MAX_WBITS + 16,
+                         8, Z_DEFAULT_STRATEGY);
+  LOG_IF(FATAL, ret != Z_OK) << "deflateInit2 failed: " << ret;
+  output->resize(deflateBound(&stream, input_length));
+  stream.next_in = (Bytef*)input;
+  stream.avail_in = input_length;
+  stream.next_out = output->data();
+  stream.avail_out = output->size();
+  ret = deflate(&stream, Z_FINISH);
+  LOG_IF(FATAL, ret != Z_STREAM_END) << "deflate failed: " << ret;
+  output->resize(stream.total_out);
+  deflateEnd(&stream);
+}
+
+void ZstdCompress(int level, const uint8_t* input, size_t input_length,
+                  vector<uint8_t>* output) {
+  if (level == kCodecDefaultCompressionLevel) {
+    level = ZSTD_CLEVEL_DEFAULT;
+  }
+  output->resize(ZSTD_compressBound(input_length));
+  size_t compressed_length = ZSTD_compress(output->data(), output->size(),
+                                           input, input_length, level);
+  LOG_IF(FATAL, ZSTD_isError(compressed_length))
+      << "ZSTD_compress failed: " << ZSTD_getErrorName(compressed_length);
+  output->resize(compressed_length);
+}
+
+bool SnappyDecompress(const uint8_t* input, size_t input_length,
+                      vector<uint8_t>* output) {
+  size_t length;
+  if (!snappy::GetUncompressedLength((const char*)input, input_length,
+                                     &length) ||
+      length != output->size()) {
+    return false;
+  }
+  return snappy::RawUncompress((const char*)input, input_length,
+                               (char*)output->data());
+}
+
+bool GzipDecompress(const uint8_t* input, size_t input_length,
+                    vector<uint8_t>* output) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  int ret = inflateInit2(&stream, MAX_WBITS + 16);
+  LOG_IF(FATAL, ret != Z_OK) << "inflateInit2 failed: " << ret;
+  stream.next_in = (Bytef*)input;
+  stream.avail_in = input_length;
+  stream.next_out = output->data();
+  stream.avail_out = output->size();
+  ret = inflate(&stream, Z_FINISH);
+  bool ok = ret == Z_STREAM_END && stream.total_out == output->size();
+  inflateEnd(&stream);
+  return ok;
+}
+
+bool ZstdDecompress(const uint8_t* input, size_t input_length,
+                    vector<uint8_t>* output) {
+  size_t length = ZSTD_decompress(output->data(), output->size(),
+                                  input, input_length);
+  return !ZSTD_isError(length) && length == output->size();
+}
+
+}  // namespace
+
+void Compress(CompressionCodec::type codec, int level,
+              const uint8_t* input, size_t input_length,
+              vector<uint8_t>* output) {
+  CHECK_NOTNULL(output);
+  switch (codec) {
+    case CompressionCodec::SNAPPY:
+      SnappyCompress(input, input_length, output);
+      break;
+    case CompressionCodec::GZIP:
+      GzipCompress(level, input, input_length, output);
+      break;
+    case CompressionCodec::ZSTD:
+      ZstdCompress(level, input, input_length, output);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported compression codec: "
+                 << parquet::_CompressionCodec_VALUES_TO_NAMES.at(codec);
+  }
+  VLOG(2) << "\tCompressed " << input_length << " bytes to "
+          << output->size() << " bytes";
+}
+
+bool Decompress(CompressionCodec::type codec,
+                const uint8_t* input, size_t input_length,
+                size_t uncompressed_length, vector<uint8_t>* output) {
+  CHECK_NOTNULL(output);
+  output->resize(uncompressed_length);
+  switch (codec) {
+    case CompressionCodec::UNCOMPRESSED:
+      if (input_length != uncompressed_length) {
+        return false;
+      }
+      memcpy(output->data(), input, input_length);
+      return true;
+    case CompressionCodec::SNAPPY:
+      return SnappyDecompress(input, input_length, output);
+    case CompressionCodec::GZIP:
+      return GzipDecompress(input, input_length, output);
+    case CompressionCodec::ZSTD:
+      return ZstdDecompress(input, input_length, output);
+    default:
+      LOG(FATAL) << "Unsupported compression codec: "
+                 << parquet::_CompressionCodec_VALUES_TO_NAMES.at(codec);
+  }
+  return false;
+}
+
+}  // namespace parquet_file
@@ -0,0 +1,40 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include "./parquet_types.h"
+
+#include <limits.h>
+#include <vector>
+
+#ifndef PARQUET_FILE_COMPRESSION_H_
+#define PARQUET_FILE_COMPRESSION_H_
+
+using parquet::CompressionCodec;
+using std::vector;
+
+namespace parquet_file {
+
+// Compression level that tells Compress to use whatever level the
+// codec itself defaults to.
+const int kCodecDefaultCompressionLevel = INT_MIN;
+
+// Compresses input_length bytes starting at input with the given
+// codec, replacing the contents of output with the compressed bytes.
+// level is interpreted by the codec (zlib takes 1-9, zstd 1-22), and
+// ignored by codecs that don't have levels, like snappy.  Dies if
+// the codec isn't supported or compression fails.
+void Compress(CompressionCodec::type codec, int level,
+              const uint8_t* input, size_t input_length,
+              vector<uint8_t>* output);
+
+// Decompresses input_length bytes starting at input, which were
+// compressed with the given codec, replacing the contents of output
+// with the uncompressed_length bytes they decompress to.  Returns
+// false if the input is corrupt or doesn't decompress to
+// uncompressed_length bytes.  Dies if the codec isn't supported.
+bool Decompress(CompressionCodec::type codec,
+                const uint8_t* input, size_t input_length,
+                size_t uncompressed_length, vector<uint8_t>* output);
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_COMPRESSION_H_
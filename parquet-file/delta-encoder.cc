@@ -0,0 +1,157 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./delta-encoder.h"
+
+#include <glog/logging.h>
+#include <parquet-file/util/bit-stream-utils.inline.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+namespace {
+
+const uint32_t kMiniblockSize = kDeltaBlockSize / kDeltaMiniblocksPerBlock;
+
+// Number of bits needed to hold every value whose bits are in mask.
+int BitWidth(uint64_t mask) {
+  return mask == 0 ? 0 : 64 - __builtin_clzll(mask);
+}
+
+}  // namespace
+
+void PutUleb128(uint64_t value, vector<uint8_t>* output) {
+  while (value >= 0x80) {
+    output->push_back((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  output->push_back(value);
+}
+
+void PutZigZagVarint(int64_t value, vector<uint8_t>* output) {
+  PutUleb128((static_cast<uint64_t>(value) << 1) ^
+             static_cast<uint64_t>(value >> 63), output);
+}
+
+template <typename T>
+DeltaBinaryPackedEncoder<T>::DeltaBinaryPackedEncoder()
+  : num_values_(0),
+    first_value_(0),
+    last_value_(0),
+    num_deltas_(0) {
+}
+
+template <typename T>
+void DeltaBinaryPackedEncoder<T>::Put(const T* values, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    T value = values[i];
+    if (num_values_ == 0) {
+      first_value_ = value;
+    } else {
+      deltas_[num_deltas_++] = static_cast<UnsignedT>(value) -
+          static_cast<UnsignedT>(last_value_);
+      if (num_deltas_ == kDeltaBlockSize) {
+        FlushBlock();
+      }
+    }
+    last_value_ = value;
+    ++num_values_;
+  }
+}
+
+template <typename T>
+void DeltaBinaryPackedEncoder<T>::FlushBlock() {
+  if (num_deltas_ == 0) {
+    return;
+  }
+  T min_delta = static_cast<T>(deltas_[0]);
+  for (uint32_t i = 1; i < num_deltas_; ++i) {
+    min_delta = std::min(min_delta, static_cast<T>(deltas_[i]));
+  }
+  PutZigZagVarint(min_delta, &blocks_);
+
+  // Offsets from the smallest difference, which fit in the type
+  // unsigned.  The last miniblock is padded with zeros.
+  uint64_t offsets[kDeltaBlockSize];
+  for (uint32_t i = 0; i < num_deltas_; ++i) {
+    offsets[i] = static_cast<UnsignedT>(
+        deltas_[i] - static_cast<UnsignedT>(min_delta));
+  }
+  std::fill(offsets + num_deltas_, offsets + kDeltaBlockSize, 0);
+
+  // Every block has a width for each of its miniblocks, but miniblocks
+  // after the last value are left out.
+  uint32_t num_miniblocks = (num_deltas_ + kMiniblockSize - 1) / kMiniblockSize;
+  int widths[kDeltaMiniblocksPerBlock];
+  size_t packed_bytes = 0;
+  for (uint32_t m = 0; m < kDeltaMiniblocksPerBlock; ++m) {
+    uint64_t mask = 0;
+    if (m < num_miniblocks) {
+      for (uint32_t i = m * kMiniblockSize; i < (m + 1) * kMiniblockSize; ++i) {
+        mask |= offsets[i];
+      }
+    }
+    widths[m] = BitWidth(mask);
+    blocks_.push_back(widths[m]);
+    packed_bytes += widths[m] * kMiniblockSize / 8;
+  }
+
+  size_t packed_start = blocks_.size();
+  blocks_.resize(packed_start + packed_bytes);
+  impala::BitWriter writer(blocks_.data() + packed_start, packed_bytes);
+  for (uint32_t m = 0; m < num_miniblocks; ++m) {
+    CHECK(writer.PutPackedValues(offsets + m * kMiniblockSize, kMiniblockSize,
+                                 widths[m]));
+  }
+  writer.Flush();
+  CHECK_EQ(writer.bytes_written(), packed_bytes);
+  num_deltas_ = 0;
+}
+
+template <typename T>
+void DeltaBinaryPackedEncoder<T>::Flush(vector<uint8_t>* output) {
+  CHECK_NOTNULL(output);
+  FlushBlock();
+  PutUleb128(kDeltaBlockSize, output);
+  PutUleb128(kDeltaMiniblocksPerBlock, output);
+  PutUleb128(num_values_, output);
+  PutZigZagVarint(first_value_, output);
+  output->insert(output->end(), blocks_.begin(), blocks_.end());
+  num_values_ = 0;
+  first_value_ = 0;
+  last_value_ = 0;
+  blocks_.clear();
+}
+
+template class DeltaBinaryPackedEncoder<int32_t>;
+template class DeltaBinaryPackedEncoder<int64_t>;
+
+void DeltaLengthByteArrayEncoder::Put(const uint8_t* value, uint32_t length) {
+  int32_t signed_length = length;
+  lengths_.Put(&signed_length, 1);
+  bytes_.insert(bytes_.end(), value, value + length);
+}
+
+void DeltaLengthByteArrayEncoder::Flush(vector<uint8_t>* output) {
+  lengths_.Flush(output);
+  output->insert(output->end(), bytes_.begin(), bytes_.end());
+  bytes_.clear();
+}
+
+void DeltaByteArrayEncoder::Put(const uint8_t* value, uint32_t length) {
+  size_t common_length = std::min<size_t>(length, last_value_.size());
+  int32_t prefix_length =
+      std::mismatch(value, value + common_length, last_value_.begin()).first -
+      value;
+  prefix_lengths_.Put(&prefix_length, 1);
+  suffixes_.Put(value + prefix_length, length - prefix_length);
+  last_value_.assign(value, value + length);
+}
+
+void DeltaByteArrayEncoder::Flush(vector<uint8_t>* output) {
+  prefix_lengths_.Flush(output);
+  suffixes_.Flush(output);
+  last_value_.clear();
+}
+
+}  // namespace parquet_file
@@ -0,0 +1,95 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <type_traits>
+#include <vector>
+
+#ifndef PARQUET_FILE_DELTA_ENCODER_H_
+#define PARQUET_FILE_DELTA_ENCODER_H_
+
+using std::vector;
+
+namespace parquet_file {
+
+// Number of values in each block of DELTA_BINARY_PACKED data we
+// write, and the number of miniblocks each block is split into.  Each
+// miniblock is bit packed at the width of its largest delta.
+const uint32_t kDeltaBlockSize = 128;
+const uint32_t kDeltaMiniblocksPerBlock = 4;
+
+// Encodes INT32 or INT64 values as DELTA_BINARY_PACKED: the first
+// value, then blocks of the differences between consecutive values,
+// each stored as its offset from the block's smallest difference and
+// bit packed in miniblocks.  Sorted or slowly changing values, like
+// positions, take a bit or two each.  Differences wrap around like
+// the Parquet format says, so any values can be encoded.
+template <typename T>
+class DeltaBinaryPackedEncoder {
+ public:
+  DeltaBinaryPackedEncoder();
+
+  // Adds n values.
+  void Put(const T* values, size_t n);
+
+  // Appends the encoding of every value put since the last Flush() to
+  // output, and starts over.
+  void Flush(vector<uint8_t>* output);
+
+ private:
+  typedef typename std::make_unsigned<T>::type UnsignedT;
+
+  // Encodes the differences buffered so far as a block.
+  void FlushBlock();
+
+  size_t num_values_;
+  T first_value_;
+  T last_value_;
+  // Differences of the block being filled.
+  UnsignedT deltas_[kDeltaBlockSize];
+  uint32_t num_deltas_;
+  // Blocks encoded so far.
+  vector<uint8_t> blocks_;
+};
+
+// Encodes BYTE_ARRAY values as DELTA_LENGTH_BYTE_ARRAY: their lengths,
+// DELTA_BINARY_PACKED, followed by all their bytes back to back.
+class DeltaLengthByteArrayEncoder {
+ public:
+  // Adds the length bytes at value.
+  void Put(const uint8_t* value, uint32_t length);
+
+  // Appends the encoding of every value put since the last Flush() to
+  // output, and starts over.
+  void Flush(vector<uint8_t>* output);
+
+ private:
+  DeltaBinaryPackedEncoder<int32_t> lengths_;
+  vector<uint8_t> bytes_;
+};
+
+// Encodes BYTE_ARRAY values as DELTA_BYTE_ARRAY, i.e. front coded:
+// the length of the prefix each value shares with the one before it,
+// DELTA_BINARY_PACKED, followed by the rest of each value as
+// DELTA_LENGTH_BYTE_ARRAY.  Sorted values, or values that share a
+// long prefix like read names, mostly shrink to their last few bytes.
+class DeltaByteArrayEncoder {
+ public:
+  void Put(const uint8_t* value, uint32_t length);
+  void Flush(vector<uint8_t>* output);
+
+ private:
+  DeltaBinaryPackedEncoder<int32_t> prefix_lengths_;
+  DeltaLengthByteArrayEncoder suffixes_;
+  vector<uint8_t> last_value_;
+};
+
+// Append value to output as an unsigned LEB128 varint, or as a
+// zigzag encoded one for signed values.
+void PutUleb128(uint64_t value, vector<uint8_t>* output);
+void PutZigZagVarint(int64_t value, vector<uint8_t>* output);
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_DELTA_ENCODER_H_
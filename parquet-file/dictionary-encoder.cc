@@ -0,0 +1,60 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./dictionary-encoder.h"
+
+#include <glog/logging.h>
+#include <parquet-file/util/rle-encoding.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+DictionaryEncoder::DictionaryEncoder(bool length_prefixed)
+  : length_prefixed_(length_prefixed) {
+}
+
+uint32_t DictionaryEncoder::Insert(const uint8_t* value, uint32_t length) {
+  auto inserted = dictionary_index_.emplace(
+      string((const char*)value, length), dictionary_index_.size());
+  if (inserted.second) {
+    if (length_prefixed_) {
+      const uint8_t* length_bytes = (const uint8_t*)&length;
+      plain_dictionary_.insert(plain_dictionary_.end(), length_bytes,
+                               length_bytes + 4);
+    }
+    plain_dictionary_.insert(plain_dictionary_.end(), value, value + length);
+  }
+  return inserted.first->second;
+}
+
+// The RLE encoder sizes itself by the largest value it will be given,
+// so the bit width is whatever it picks for the largest index.
+int DictionaryEncoder::IndexBitWidth() const {
+  uint32_t max_index = std::max<uint32_t>(NumEntries(), 2) - 1;
+  return impala::RleEncoder::BitWidth(max_index);
+}
+
+void DictionaryEncoder::EncodeIndices(const vector<uint32_t>& indices,
+                                      size_t first_index, size_t num_indices,
+                                      vector<uint8_t>* output) const {
+  CHECK_NOTNULL(output);
+  CHECK_LE(first_index + num_indices, indices.size());
+  uint32_t max_index = std::max<uint32_t>(NumEntries(), 2) - 1;
+  int max_buffer_size =
+      impala::RleEncoder::MaxBufferSize(num_indices, max_index);
+  output->resize(1 + max_buffer_size);
+  (*output)[0] = IndexBitWidth();
+  impala::RleEncoder encoder(output->data() + 1, max_buffer_size, max_index);
+  CHECK(encoder.PutBatch(indices.data() + first_index, num_indices));
+  encoder.Flush();
+  output->resize(1 + encoder.len());
+  VLOG(2) << "\t" << num_indices << " dictionary indices occupy "
+          << output->size() << " bytes encoded";
+}
+
+void DictionaryEncoder::Clear() {
+  dictionary_index_.clear();
+  plain_dictionary_.clear();
+}
+
+}  // namespace parquet_file
@@ -0,0 +1,69 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef PARQUET_FILE_DICTIONARY_ENCODER_H_
+#define PARQUET_FILE_DICTIONARY_ENCODER_H_
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace parquet_file {
+
+// Default limit on the size of a column chunk's PLAIN encoded
+// dictionary.  Columns whose dictionary grows past it are written
+// PLAIN instead.
+const uint32_t kMaxDictionaryPageSize = 1024 * 1024;
+
+// DictionaryEncoder assigns each distinct value it's given an index,
+// in the order the values are first seen, and keeps the distinct
+// values PLAIN encoded for the column chunk's dictionary page.
+class DictionaryEncoder {
+ public:
+  // If length_prefixed is true, values are BYTE_ARRAYs and are
+  // written to the dictionary with a 4 byte length in front of them,
+  // as PLAIN encoding does.
+  explicit DictionaryEncoder(bool length_prefixed);
+
+  // Returns the index of the length bytes at value, adding them to
+  // the dictionary if they haven't been seen before.
+  uint32_t Insert(const uint8_t* value, uint32_t length);
+
+  // Number of distinct values in the dictionary.
+  uint32_t NumEntries() const { return dictionary_index_.size(); }
+
+  // The dictionary page body: every distinct value, PLAIN encoded, in
+  // index order.
+  const vector<uint8_t>& PlainEncodedDictionary() const {
+    return plain_dictionary_;
+  }
+
+  // Width, in bits, of the indices written by EncodeIndices.
+  int IndexBitWidth() const;
+
+  // Encodes num_indices indices, starting at first_index in indices,
+  // as a data page's values: one byte of bit width followed by the
+  // indices in the RLE/bit-packed hybrid encoding.  Replaces the
+  // contents of output.
+  void EncodeIndices(const vector<uint32_t>& indices,
+                     size_t first_index, size_t num_indices,
+                     vector<uint8_t>* output) const;
+
+  // Discards all values, e.g. when a column chunk has been written.
+  void Clear();
+
+ private:
+  bool length_prefixed_;
+  // Map from each distinct value to its index.
+  unordered_map<string, uint32_t> dictionary_index_;
+  vector<uint8_t> plain_dictionary_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_DICTIONARY_ENCODER_H_
@@ -0,0 +1,151 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./level-runs.h"
+
+#include <glog/logging.h>
+#include <limits.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+LevelRuns::LevelRuns() {
+}
+
+void LevelRuns::Append(uint8_t level, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  size_t new_size = size() + count;
+  CHECK_LE(new_size, UINT32_MAX) << "Too many levels in one column chunk";
+  if (!segment_ends_.empty()) {
+    size_t last = segment_ends_.size() - 1;
+    if (!IsLiteral(last)) {
+      if (segment_levels_[last] == level) {
+        segment_ends_[last] = new_size;
+        return;
+      }
+    } else {
+      // The literal levels may already end with some of level.  If
+      // they and the new ones make a long enough run, they all move to
+      // a run segment; otherwise the new ones are literal too.
+      size_t literal_start = LiteralStart(last);
+      size_t tail = 0;
+      while (tail < kMinLevelRunLength &&
+             literals_.size() - tail > literal_start &&
+             literals_[literals_.size() - 1 - tail] == level) {
+        ++tail;
+      }
+      if (tail + count < kMinLevelRunLength) {
+        literals_.insert(literals_.end(), count, level);
+        segment_ends_[last] = new_size;
+        segment_literal_ends_[last] = literals_.size();
+        return;
+      }
+      literals_.resize(literals_.size() - tail);
+      count += tail;
+      if (literals_.size() == literal_start) {
+        segment_ends_.pop_back();
+        segment_literal_ends_.pop_back();
+        segment_levels_.pop_back();
+      } else {
+        segment_ends_[last] -= tail;
+        segment_literal_ends_[last] = literals_.size();
+      }
+    }
+  }
+  if (count < kMinLevelRunLength) {
+    literals_.insert(literals_.end(), count, level);
+  }
+  segment_ends_.push_back(new_size);
+  segment_literal_ends_.push_back(literals_.size());
+  segment_levels_.push_back(level);
+}
+
+size_t LevelRuns::SegmentContaining(size_t index) const {
+  return std::upper_bound(segment_ends_.begin(), segment_ends_.end(),
+                          index) - segment_ends_.begin();
+}
+
+size_t LevelRuns::NumRuns() const {
+  size_t num_runs = 0;
+  ForEachRun(0, size(), [&num_runs] (uint8_t level, size_t count) {
+      ++num_runs;
+    });
+  return num_runs;
+}
+
+size_t LevelRuns::BytesUsed() const {
+  return literals_.size() +
+      segment_ends_.size() * (sizeof(segment_ends_[0]) +
+                              sizeof(segment_literal_ends_[0]) +
+                              sizeof(segment_levels_[0]));
+}
+
+uint8_t LevelRuns::at(size_t index) const {
+  CHECK_LT(index, size()) << "Level index out of range";
+  size_t segment = SegmentContaining(index);
+  if (!IsLiteral(segment)) {
+    return segment_levels_[segment];
+  }
+  return literals_[LiteralStart(segment) + index - SegmentStart(segment)];
+}
+
+void LevelRuns::ForEachRun(
+    size_t first_level, size_t num_levels,
+    const function<void(uint8_t, size_t)>& callback) const {
+  CHECK_LE(first_level + num_levels, size()) << "Level range out of range";
+  // Runs are only passed on once they end, so one that spans segments
+  // comes out whole.
+  uint8_t run_level = 0;
+  size_t run_length = 0;
+  auto add_levels = [&callback, &run_level, &run_length] (uint8_t level,
+                                                          size_t count) {
+    if (run_length > 0 && level != run_level) {
+      callback(run_level, run_length);
+      run_length = 0;
+    }
+    run_level = level;
+    run_length += count;
+  };
+  size_t end = first_level + num_levels;
+  size_t index = first_level;
+  for (size_t segment = SegmentContaining(first_level); index < end;
+       ++segment) {
+    size_t segment_end = std::min<size_t>(segment_ends_[segment], end);
+    if (!IsLiteral(segment)) {
+      add_levels(segment_levels_[segment], segment_end - index);
+    } else {
+      const uint8_t* literals =
+          &literals_[LiteralStart(segment) + index - SegmentStart(segment)];
+      for (size_t i = 0; i < segment_end - index; ++i) {
+        add_levels(literals[i], 1);
+      }
+    }
+    index = segment_end;
+  }
+  if (run_length > 0) {
+    callback(run_level, run_length);
+  }
+}
+
+size_t LevelRuns::Count(size_t first_level, size_t num_levels,
+                        uint8_t level) const {
+  size_t count = 0;
+  ForEachRun(first_level, num_levels,
+             [level, &count] (uint8_t run_level, size_t run_length) {
+               if (run_level == level) {
+                 count += run_length;
+               }
+             });
+  return count;
+}
+
+void LevelRuns::clear() {
+  segment_ends_.clear();
+  segment_literal_ends_.clear();
+  segment_levels_.clear();
+  literals_.clear();
+}
+
+}  // namespace parquet_file
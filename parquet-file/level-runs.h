@@ -0,0 +1,91 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#ifndef PARQUET_FILE_LEVEL_RUNS_H_
+#define PARQUET_FILE_LEVEL_RUNS_H_
+
+using std::function;
+using std::vector;
+
+namespace parquet_file {
+
+// Shortest run of identical levels LevelRuns stores as a run.
+const size_t kMinLevelRunLength = 8;
+
+// LevelRuns holds a sequence of repetition or definition levels as
+// runs of identical levels.  Levels are appended a run at a time,
+// which is how columns produce them, so a column whose levels never
+// change takes up a single run no matter how many values it has.
+// Levels in runs shorter than kMinLevelRunLength, e.g. alternating
+// ones, are kept literally instead, a byte each, so they never take
+// up more than about a byte per level.
+class LevelRuns {
+ public:
+  LevelRuns();
+
+  // Appends count copies of level.
+  void Append(uint8_t level, size_t count);
+
+  // Total number of levels.
+  size_t size() const {
+    return segment_ends_.empty() ? 0 : segment_ends_.back();
+  }
+
+  // Number of runs of identical levels.  Takes time linear in the
+  // number of runs.
+  size_t NumRuns() const;
+
+  // Bytes the levels take up, not counting spare capacity.
+  size_t BytesUsed() const;
+
+  // Returns the level at index.
+  uint8_t at(size_t index) const;
+
+  // Calls callback(level, count) for each run of identical levels
+  // among the num_levels levels starting at first_level, in order.
+  // The first and last runs are trimmed to the range.
+  void ForEachRun(size_t first_level, size_t num_levels,
+                  const function<void(uint8_t, size_t)>& callback) const;
+
+  // Returns how many of the num_levels levels starting at first_level
+  // equal level.
+  size_t Count(size_t first_level, size_t num_levels, uint8_t level) const;
+
+  // Removes all levels.
+  void clear();
+
+ private:
+  // Index of the segment containing the level at index.
+  size_t SegmentContaining(size_t index) const;
+  size_t SegmentStart(size_t segment) const {
+    return segment == 0 ? 0 : segment_ends_[segment - 1];
+  }
+  // Index in literals_ of the first level of a literal segment.
+  size_t LiteralStart(size_t segment) const {
+    return segment == 0 ? 0 : segment_literal_ends_[segment - 1];
+  }
+  bool IsLiteral(size_t segment) const {
+    return segment_literal_ends_[segment] != LiteralStart(segment);
+  }
+
+  // The levels are a sequence of segments, each either a run of one
+  // level or some levels stored literally.  For each segment, the
+  // index one past its last level, and the size of literals_ after
+  // it, which only literal segments add to.  Columns are reset after
+  // every row group, so 32 bits is plenty.
+  vector<uint32_t> segment_ends_;
+  vector<uint32_t> segment_literal_ends_;
+  // The level of each run segment; unused for literal segments.
+  vector<uint8_t> segment_levels_;
+  // The levels of every literal segment, back to back.
+  vector<uint8_t> literals_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_LEVEL_RUNS_H_
@@ -8,8 +8,11 @@
 #include <boost/shared_array.hpp>
 #include <parquet-file/util/rle-encoding.h>
 #include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 
 using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using parquet::DictionaryPageHeader;
 using parquet::PageHeader;
 using parquet::PageType;
 
@@ -32,18 +35,35 @@ ParquetColumn::ParquetColumn(const vector<string>& column_name,
     data_type_(data_type),
     num_datums_(0),
     compression_codec_(compression_codec),
+    compression_level_(kCodecDefaultCompressionLevel),
     // I'm purposely using the constructor parameter in the next line,
     // as opposed to data_type_, in order to be clear that I'm am
     // avoiding a dependency on the order of variable declarations in
     // the class.
     bytes_per_datum_(BytesForDataType(data_type)),
+    uncompressed_bytes_(0),
+    compressed_bytes_(0),
+    data_page_size_(kDataBytesPerPage),
+    num_data_pages_(0),
+    header_buffer_(new TMemoryBuffer()),
+    header_protocol_(new TCompactProtocol(header_buffer_)),
+    dictionary_(data_type == parquet::Type::BYTE_ARRAY),
+    statistics_(data_type),
+    has_column_index_(false),
+    dictionary_page_size_limit_(kMaxDictionaryPageSize),
+    dictionary_fallback_(false),
+    chunk_dictionary_encoded_(false),
+    dictionary_page_bytes_(0),
+    num_levels_(0),
+    num_records_(0),
+    implicit_data_offsets_(true),
+    num_routed_records_(0),
     column_write_offset_(-1L) {
   if (data_buffer.get() != nullptr) {
-    data_buffer_.reset(data_buffer.get());
-  } else {
-    data_buffer_.reset(new uint8_t[1024000]);
+    CHECK_GT(data_buffer_size_in_bytes, 0) <<
+        "Size of provided data buffer must be specified";
+    data_buffer_.AddChunk(data_buffer, data_buffer_size_in_bytes);
   }
-  data_ptr_ = data_buffer_.get();
 }
 
 ParquetColumn::ParquetColumn(const vector<string>& column_name,
@@ -52,9 +72,47 @@ ParquetColumn::ParquetColumn(const vector<string>& column_name,
     repetition_type_(repetition_type),
     num_datums_(0),
     data_type_(parquet::Type::BOOLEAN),
+    compression_codec_(CompressionCodec::UNCOMPRESSED),
+    compression_level_(kCodecDefaultCompressionLevel),
+    uncompressed_bytes_(0),
+    compressed_bytes_(0),
+    data_page_size_(kDataBytesPerPage),
+    num_data_pages_(0),
+    header_buffer_(new TMemoryBuffer()),
+    header_protocol_(new TCompactProtocol(header_buffer_)),
+    dictionary_(false),
+    statistics_(parquet::Type::BOOLEAN),
+    has_column_index_(false),
+    dictionary_page_size_limit_(kMaxDictionaryPageSize),
+    dictionary_fallback_(false),
+    chunk_dictionary_encoded_(false),
+    dictionary_page_bytes_(0),
+    num_levels_(0),
+    num_records_(0),
+    implicit_data_offsets_(true),
+    num_routed_records_(0),
     column_write_offset_(-1L) {
 }
 
+ParquetColumn* ParquetColumn::CloneWithoutData() const {
+  ParquetColumn* clone;
+  if (children_.size() > 0) {
+    clone = new ParquetColumn(column_name_, repetition_type_);
+  } else {
+    clone = new ParquetColumn(column_name_, data_type_,
+                              max_repetition_level_, max_definition_level_,
+                              repetition_type_, encoding_,
+                              compression_codec_);
+  }
+  clone->compression_level_ = compression_level_;
+  clone->data_page_size_ = data_page_size_;
+  clone->dictionary_page_size_limit_ = dictionary_page_size_limit_;
+  if (bloom_filter_) {
+    clone->bloom_filter_.reset(new BloomFilter(bloom_filter_->NumBytes()));
+  }
+  return clone;
+}
+
 const vector<ParquetColumn*>& ParquetColumn::Children() const {
   return children_;
 }
@@ -79,6 +137,7 @@ void ParquetColumn::setType(Type::type type) {
     LOG(WARNING) << "Changing column type after records added; are you sure?";
   }
   data_type_ = type;
+  statistics_ = ColumnStatistics(type);
 }
 
 Type::type ParquetColumn::getType() const {
@@ -89,6 +148,91 @@ CompressionCodec::type ParquetColumn::getCompressionCodec() const {
   return compression_codec_;
 }
 
+void ParquetColumn::setCompressionLevel(int compression_level) {
+  compression_level_ = compression_level;
+}
+
+int ParquetColumn::getCompressionLevel() const {
+  return compression_level_;
+}
+
+void ParquetColumn::setDataPageSize(uint32_t data_page_size) {
+  CHECK_GT(data_page_size, 0) << "Data page size must be positive";
+  data_page_size_ = data_page_size;
+}
+
+uint32_t ParquetColumn::getDataPageSize() const {
+  return data_page_size_;
+}
+
+void ParquetColumn::setDictionaryPageSizeLimit(
+    uint32_t dictionary_page_size_limit) {
+  dictionary_page_size_limit_ = dictionary_page_size_limit;
+  MaybeFallBackToPlainEncoding();
+}
+
+uint32_t ParquetColumn::getDictionaryPageSizeLimit() const {
+  return dictionary_page_size_limit_;
+}
+
+bool ParquetColumn::IsDictionaryEncoded() const {
+  return (encoding_ == Encoding::PLAIN_DICTIONARY ||
+          encoding_ == Encoding::RLE_DICTIONARY) && !dictionary_fallback_;
+}
+
+void ParquetColumn::AddToDictionary(const uint8_t* values,
+                                    uint32_t value_length, uint32_t n) {
+  if (!IsDictionaryEncoded()) {
+    return;
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    dictionary_indices_.push_back(dictionary_.Insert(values, value_length));
+    values += value_length;
+  }
+  MaybeFallBackToPlainEncoding();
+}
+
+void ParquetColumn::EnableBloomFilter(uint64_t expected_distinct_values,
+                                      double fpp) {
+  LOG_IF(FATAL, !children_.empty()) <<
+      "Cannot add a Bloom filter to a container column: " << FullSchemaPath();
+  LOG_IF(FATAL, num_levels_ > 0) <<
+      "Enable the Bloom filter of " << FullSchemaPath()
+      << " before adding data to it";
+  bloom_filter_.reset(new BloomFilter(
+      BloomFilter::OptimalNumBytes(expected_distinct_values, fpp)));
+}
+
+bool ParquetColumn::HasBloomFilter() const {
+  return bloom_filter_ != nullptr;
+}
+
+void ParquetColumn::AddToBloomFilter(const uint8_t* values,
+                                     uint32_t value_length, uint32_t n) {
+  if (!bloom_filter_) {
+    return;
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    bloom_filter_->Insert(BloomFilter::Hash(values, value_length));
+    values += value_length;
+  }
+}
+
+void ParquetColumn::MaybeFallBackToPlainEncoding() {
+  if (!IsDictionaryEncoded() ||
+      dictionary_.PlainEncodedDictionary().size() <=
+      dictionary_page_size_limit_) {
+    return;
+  }
+  VLOG(2) << "Dictionary for " << FullSchemaPath() << " has "
+          << dictionary_.NumEntries() << " entries, more than "
+          << dictionary_page_size_limit_ << " bytes; writing PLAIN";
+  dictionary_fallback_ = true;
+  dictionary_.Clear();
+  // Release the memory, too; we won't need it until the next chunk.
+  vector<uint32_t>().swap(dictionary_indices_);
+}
+
 string ParquetColumn::FullSchemaPath() const {
   if (column_name_.size() > 0) {
     return boost::algorithm::join(column_name_, ".");
@@ -110,79 +254,161 @@ string ParquetColumn::ToString() const {
       + parquet::_FieldRepetitionType_VALUES_TO_NAMES.at(this->getFieldRepetitionType())
       + "/" + to_string(Children().size()) + " children"
       + "/" + parquet::_Type_VALUES_TO_NAMES.at(this->getType())
-      + "/" + to_string(record_metadata.size()) + " records"
+      + "/" + to_string(num_records_) + " records"
       + "/" + to_string(num_datums_) + " pieces of data"
-      + "/" + to_string(bytes_per_datum_) + " bytes per datum";
+      + "/" + to_string(bytes_per_datum_) + " bytes per datum"
+      + "/" + to_string(data_page_size_) + " bytes per data page";
 }
 
 void ParquetColumn::AddSingletonValueAsNRecords(void* buf,
                                                 uint16_t repetition_level,
                                                 uint32_t n) {
+  if (!shard_columns_.empty()) {
+    RouteRecords((const uint8_t*)buf, 0, bytes_per_datum_, n,
+                 [buf, repetition_level] (ParquetColumn* shard,
+                                          uint32_t first, uint32_t count) {
+                   shard->AddSingletonValueAsNRecords(buf, repetition_level,
+                                                      count);
+                 });
+    return;
+  }
   CHECK_LT(repetition_level, max_repetition_level_) <<
     "For adding repeated data in this column, use AddRepeatedData";
-  record_metadata.reserve(record_metadata.size() + n);
-  repetition_levels_.reserve(repetition_levels_.size() + n);
-  definition_levels_.reserve(definition_levels_.size() + n);
   // TODO: check for overflow of multiply
   num_datums_ += n;
-  size_t rep_start = repetition_levels_.size();
-  size_t def_start = definition_levels_.size();
-  
-  switch(bytes_per_datum_) {
-    case 4:
-      std::fill((uint32_t*)data_ptr_, (uint32_t*)(data_ptr_ + (bytes_per_datum_ * n)), *(uint32_t*)buf);
-      break;
-    case 8:
-      std::fill((uint64_t*)data_ptr_, (uint64_t*)(data_ptr_ + (bytes_per_datum_ * n)), *(uint64_t*)buf);
-      break;
-    default:
-      CHECK(0) << "Singleton fill for unsupported byte width";
+  size_t level_start = AddLevels(repetition_level, max_definition_level_, n);
+  uint32_t datums_added = 0;
+  while (datums_added < n) {
+    uint32_t batch = DatumsThatFitContiguously(n - datums_added);
+    size_t data_start = data_buffer_.Size();
+    uint8_t* data_ptr = data_buffer_.Allocate(bytes_per_datum_ * batch);
+    switch(bytes_per_datum_) {
+      case 4:
+        std::fill((uint32_t*)data_ptr, (uint32_t*)data_ptr + batch, *(uint32_t*)buf);
+        break;
+      case 8:
+        std::fill((uint64_t*)data_ptr, (uint64_t*)data_ptr + batch, *(uint64_t*)buf);
+        break;
+      default:
+        CHECK(0) << "Singleton fill for unsupported byte width";
+    }
+    AddFixedWidthRecordMetadata(level_start + datums_added, data_start, batch);
+    datums_added += batch;
   }
-  repetition_levels_.insert(repetition_levels_.end(), n, repetition_level);
-  definition_levels_.insert(definition_levels_.end(), n, max_definition_level_);
-  for (int i = 0; i < n; ++i) {
-    AddRecordMetadata(rep_start + i, rep_start + i + 1,
-                      def_start + i, def_start + i + 1,
-                      data_ptr_, data_ptr_ + bytes_per_datum_);
-    data_ptr_ += bytes_per_datum_;
+  if (n > 0) {
+    statistics_.AddValues((const uint8_t*)buf, 1);
+    AddToBloomFilter((const uint8_t*)buf, bytes_per_datum_, 1);
+  }
+  if (IsDictionaryEncoded()) {
+    // Every record has the same value, so look it up once.
+    dictionary_indices_.insert(dictionary_indices_.end(), n,
+                               dictionary_.Insert((uint8_t*)buf,
+                                                  bytes_per_datum_));
+    MaybeFallBackToPlainEncoding();
+  }
+}
+
+uint32_t ParquetColumn::DatumsThatFitContiguously(uint32_t n) const {
+  size_t datums_available =
+      data_buffer_.BytesAvailableInCurrentChunk() / bytes_per_datum_;
+  if (datums_available == 0) {
+    // Allocating will start a new chunk, which is at least as big as
+    // the request.
+    return n;
+  }
+  return std::min<size_t>(n, datums_available);
+}
+
+void ParquetColumn::AddRecordMetadata(size_t level_end, size_t data_end) {
+  if (HasRepetitionLevels()) {
+    LOG_IF(FATAL, level_end > UINT32_MAX) << "More than 4G levels in "
+        << FullSchemaPath() << "; write row groups more often";
+    record_level_ends_.push_back(level_end);
+  } else {
+    DCHECK_EQ(level_end, num_records_ + 1);
+  }
+  bool store_data_end = !implicit_data_offsets_ ||
+      getType() == parquet::Type::BYTE_ARRAY ||
+      data_end != (num_records_ + 1) * bytes_per_datum_;
+  // Every stored end is at most this one, so checking it covers the
+  // ones computed below too.
+  LOG_IF(FATAL, store_data_end && data_end > UINT32_MAX)
+      << "More than 4 GiB of data in " << FullSchemaPath()
+      << "; write row groups more often";
+  if (implicit_data_offsets_ && store_data_end) {
+    // This record isn't one fixed-width value, so from now on every
+    // record's data end has to be stored.
+    record_data_ends_.reserve(num_records_ + 1);
+    for (uint32_t i = 0; i < num_records_; ++i) {
+      record_data_ends_.push_back(RecordDataEnd(i));
+    }
+    implicit_data_offsets_ = false;
   }
+  if (store_data_end) {
+    record_data_ends_.push_back(data_end);
+  }
+  LOG_IF(FATAL, num_records_ == UINT32_MAX) << "Too many records in "
+      << FullSchemaPath() << "; write row groups more often";
+  ++num_records_;
 }
 
-void ParquetColumn::AddRecordMetadata(size_t rep_level_start, size_t rep_level_end,
-                                      size_t def_level_start, size_t def_level_end,
-                                      uint8_t* start, uint8_t* end) {
-  RecordMetadata r;
-  r.repetition_level_index_start = rep_level_start;
-  r.repetition_level_index_end = rep_level_end;
-  r.definition_level_index_start = def_level_start;
-  r.definition_level_index_end = def_level_end;
-  r.byte_begin = start;
-  r.byte_end = end;
-  record_metadata.push_back(r);
+void ParquetColumn::AddFixedWidthRecordMetadata(size_t level_start,
+                                                size_t data_start,
+                                                uint32_t n) {
+  if (implicit_data_offsets_ && !HasRepetitionLevels() &&
+      data_start == num_records_ * bytes_per_datum_) {
+    // Nothing to store; the records' offsets follow from their index.
+    LOG_IF(FATAL, num_records_ + (uint64_t)n > UINT32_MAX) <<
+        "Too many records in " << FullSchemaPath() <<
+        "; write row groups more often";
+    num_records_ += n;
+    return;
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    AddRecordMetadata(level_start + i + 1,
+                      data_start + (i + 1) * bytes_per_datum_);
+  }
 }
 
 void ParquetColumn::AddRecords(void* buf, uint16_t repetition_level,
                                uint32_t n) {
+  if (!shard_columns_.empty()) {
+    uint8_t* values = (uint8_t*)buf;
+    size_t width = bytes_per_datum_;
+    RouteRecords(values, width, width, n,
+                 [values, width, repetition_level] (ParquetColumn* shard,
+                                                    uint32_t first,
+                                                    uint32_t count) {
+                   shard->AddRecords(values + first * width, repetition_level,
+                                     count);
+                 });
+    return;
+  }
   CHECK_LT(repetition_level, max_repetition_level_) <<
     "For adding repeated data in this column, use AddRepeatedData";
-  record_metadata.reserve(record_metadata.size() + n);
-  // TODO: check for overflow of multiply
-  size_t num_bytes = n * bytes_per_datum_;
-  memcpy(data_ptr_, buf, num_bytes);
+  LOG_IF(FATAL, getType() == parquet::Type::BYTE_ARRAY) <<
+      "Use AddVariableLengthByteArray to add data to a BYTE_ARRAY column";
   num_datums_ += n;
 
-  size_t rep_start = repetition_levels_.size();
-  size_t def_start = definition_levels_.size();
+  size_t level_start = AddLevels(repetition_level, max_definition_level_, n);
 
-  repetition_levels_.insert(repetition_levels_.end(), n, repetition_level);
-  definition_levels_.insert(definition_levels_.end(), n, max_definition_level_);
-
-  for (int i = 0; i < n; ++i) {
-    AddRecordMetadata(rep_start + i, rep_start + i + 1,
-                      def_start + i, def_start + i + 1,
-                      data_ptr_, data_ptr_ + bytes_per_datum_);
+  // Records are never split across chunks of the data buffer, so copy
+  // as many as fit in the current chunk at a time.
+  const uint8_t* src = (const uint8_t*)buf;
+  uint32_t datums_added = 0;
+  while (datums_added < n) {
+    uint32_t batch = DatumsThatFitContiguously(n - datums_added);
+    // TODO: check for overflow of multiply
+    size_t num_bytes = batch * bytes_per_datum_;
+    size_t data_start = data_buffer_.Size();
+    data_buffer_.Append(src, num_bytes);
+    AddFixedWidthRecordMetadata(level_start + datums_added, data_start, batch);
+    src += num_bytes;
+    datums_added += batch;
   }
-  data_ptr_ += num_bytes;
+  statistics_.AddValues((const uint8_t*)buf, n);
+  AddToBloomFilter((const uint8_t*)buf, bytes_per_datum_, n);
+  AddToDictionary((const uint8_t*)buf, bytes_per_datum_, n);
 }
 
 // Adds repeated data to this column.  All data is considered part
@@ -190,47 +416,58 @@ void ParquetColumn::AddRecords(void* buf, uint16_t repetition_level,
 void ParquetColumn::AddRepeatedData(void *buf,
                                     uint16_t current_repetition_level,
                                     uint32_t n) {
+  if (!shard_columns_.empty()) {
+    RouteRecords((const uint8_t*)buf, 0, n * bytes_per_datum_, 1,
+                 [buf, current_repetition_level, n] (ParquetColumn* shard,
+                                                     uint32_t first,
+                                                     uint32_t count) {
+                   shard->AddRepeatedData(buf, current_repetition_level, n);
+                 });
+    return;
+  }
   LOG_IF(FATAL, getFieldRepetitionType() != FieldRepetitionType::REPEATED) <<
     "Cannot add repeated data to a non-repeated column: " << FullSchemaPath();
+  // The whole record has to be contiguous, so it may start a new
+  // chunk of the data buffer.
   size_t num_bytes = n * bytes_per_datum_;
-  memcpy(data_ptr_, buf, n * bytes_per_datum_);
+  data_buffer_.Append(buf, num_bytes);
 
-  size_t rep_start = repetition_levels_.size();
-  size_t def_start = definition_levels_.size();
+  // The first value repeats at the record's level; the rest repeat
+  // at this column's level.
+  size_t level_start = AddLevels(current_repetition_level,
+                                 max_definition_level_, 1);
+  AddLevels(max_repetition_level_, max_definition_level_, n - 1);
 
-  repetition_levels_.push_back(current_repetition_level);
-  repetition_levels_.insert(repetition_levels_.end(), n - 1, max_repetition_level_);
+  AddRecordMetadata(level_start + n, data_buffer_.Size());
 
-  definition_levels_.insert(definition_levels_.end(), n, max_definition_level_);
-
-  AddRecordMetadata(rep_start, rep_start + n,
-                    def_start, def_start + n,
-                    data_ptr_, data_ptr_ + num_bytes);
-
-  data_ptr_ += num_bytes;
   num_datums_ += n;
+  statistics_.AddValues((const uint8_t*)buf, n);
+  AddToBloomFilter((const uint8_t*)buf, bytes_per_datum_, n);
+  AddToDictionary((const uint8_t*)buf, bytes_per_datum_, n);
 }
 
 void ParquetColumn::AddNulls(uint16_t current_repetition_level,
                              uint16_t current_definition_level,
                              uint32_t n) {
+  if (!shard_columns_.empty()) {
+    RouteRecords(nullptr, 0, 0, n,
+                 [current_repetition_level, current_definition_level]
+                 (ParquetColumn* shard, uint32_t first, uint32_t count) {
+                   shard->AddNulls(current_repetition_level,
+                                   current_definition_level, count);
+                 });
+    return;
+  }
   LOG_IF(FATAL, getFieldRepetitionType() != FieldRepetitionType::OPTIONAL) <<
     "Cannot add NULL to non-optional column: " << FullSchemaPath();
 
-  record_metadata.reserve(record_metadata.size() + n);
-  repetition_levels_.reserve(repetition_levels_.size() + n);
-  definition_levels_.reserve(definition_levels_.size() + n);
-
-  size_t rep_start = repetition_levels_.size();
-  size_t def_start = definition_levels_.size();
-
-  repetition_levels_.insert(repetition_levels_.end(), n, current_repetition_level);
-  definition_levels_.insert(definition_levels_.end(), n, current_definition_level);
+  size_t level_start = AddLevels(current_repetition_level,
+                                 current_definition_level, n);
+  statistics_.AddNulls(n);
 
+  // Nulls have no data, so they all end where the data does.
   for (int i = 0; i < n; ++i) {
-    AddRecordMetadata(rep_start + i, rep_start + i + 1,
-                      def_start + i, def_start + i + 1,
-                      data_ptr_, data_ptr_);
+    AddRecordMetadata(level_start + i + 1, data_buffer_.Size());
   }
 }
 
@@ -239,32 +476,94 @@ void ParquetColumn::AddVariableLengthByteArray(
     void* buf,
     uint16_t current_repetition_level,
     uint32_t length) {
+  if (!shard_columns_.empty()) {
+    RouteRecords((const uint8_t*)buf, 0, length, 1,
+                 [buf, current_repetition_level, length]
+                 (ParquetColumn* shard, uint32_t first, uint32_t count) {
+                   shard->AddVariableLengthByteArray(
+                       buf, current_repetition_level, length);
+                 });
+    return;
+  }
   LOG_IF(FATAL, getType() != parquet::Type::BYTE_ARRAY) <<
       "Column is not of type BYTE_ARRAY";
   CHECK_GT(length, 0) << "Use AddNulls to add a null element";
-  size_t rep_start = repetition_levels_.size();
-  size_t def_start = definition_levels_.size();
+  size_t level_start = AddLevels(current_repetition_level,
+                                 max_definition_level_, 1);
 
-  repetition_levels_.push_back(current_repetition_level);
-  definition_levels_.push_back(max_definition_level_);
+  // The length prefix and the bytes are allocated together so the
+  // record stays contiguous.
+  uint8_t* data_ptr = data_buffer_.Allocate(4 + length);
+  memcpy(data_ptr, &length, 4);
+  memcpy(data_ptr + 4, buf, length);
+  AddRecordMetadata(level_start + 1, data_buffer_.Size());
+  statistics_.AddByteArray((const uint8_t*)buf, length);
+  AddToBloomFilter((const uint8_t*)buf, length, 1);
+  AddToDictionary((const uint8_t*)buf, length, 1);
+}
 
-  AddRecordMetadata(rep_start, rep_start + 1,
-                    def_start, def_start + 1,
-                    data_ptr_, data_ptr_ + 4 + length);
-  memcpy(data_ptr_, &length, 4);
-  data_ptr_ += 4;
-  memcpy(data_ptr_, buf, length);
-  data_ptr_ += length;
+void ParquetColumn::RouteRecordsTo(const vector<ParquetColumn*>& shard_columns,
+                                   const RecordRouter& router) {
+  LOG_IF(FATAL, num_records_ > 0 || num_routed_records_ > 0)
+      << "Records were added to " << FullSchemaPath()
+      << " before it was routed to shards";
+  shard_columns_ = shard_columns;
+  record_router_ = router;
+}
+
+void ParquetColumn::RouteRecords(
+    const uint8_t* data, size_t stride, size_t length, uint32_t n,
+    const function<void(ParquetColumn*, uint32_t, uint32_t)>& add) {
+  uint32_t run_start = 0;
+  int run_shard = -1;
+  for (uint32_t i = 0; i < n; ++i) {
+    int shard = record_router_(num_routed_records_++,
+                               data ? data + i * stride : nullptr, length);
+    DCHECK_LT(shard, shard_columns_.size());
+    if (shard != run_shard && i > run_start) {
+      add(shard_columns_[run_shard], run_start, i - run_start);
+      run_start = i;
+    }
+    run_shard = shard;
+  }
+  if (n > run_start) {
+    add(shard_columns_[run_shard], run_start, n - run_start);
+  }
 }
 
 uint32_t ParquetColumn::NumRecords() const {
-  return record_metadata.size();
+  return num_records_;
 }
 
 uint32_t ParquetColumn::NumDatums() const {
   return num_datums_;
 }
 
+uint32_t ParquetColumn::NumDataPages() const {
+  return num_data_pages_;
+}
+
+void ParquetColumn::Reset() {
+  num_records_ = 0;
+  record_level_ends_.clear();
+  record_data_ends_.clear();
+  implicit_data_offsets_ = true;
+  repetition_levels_.clear();
+  definition_levels_.clear();
+  num_levels_ = 0;
+  data_buffer_.Clear();
+  encoded_pages_.clear();
+  encoded_segments_.clear();
+  num_datums_ = 0;
+  dictionary_.Clear();
+  dictionary_indices_.clear();
+  dictionary_fallback_ = false;
+  statistics_.Reset();
+  if (bloom_filter_) {
+    bloom_filter_->Clear();
+  }
+}
+
 // static
 uint8_t ParquetColumn::BytesForDataType(Type::type dataType) {
   // TODO support boolean (which is 1 bit)
@@ -304,20 +603,45 @@ void ParquetColumn::AddChild(ParquetColumn* child) {
   children_.push_back(child);
 }
 
-void ParquetColumn::EncodeLevels(const vector<uint8_t>& level_vector,
+size_t ParquetColumn::AddLevels(uint16_t repetition_level,
+                                uint16_t definition_level, size_t n) {
+  size_t level_start = num_levels_;
+  if (HasRepetitionLevels()) {
+    repetition_levels_.Append(repetition_level, n);
+  }
+  if (HasDefinitionLevels()) {
+    definition_levels_.Append(definition_level, n);
+  }
+  num_levels_ += n;
+  return level_start;
+}
+
+bool ParquetColumn::HasRepetitionLevels() const {
+  return getFieldRepetitionType() == FieldRepetitionType::REPEATED;
+}
+
+bool ParquetColumn::HasDefinitionLevels() const {
+  FieldRepetitionType::type repetition_type = getFieldRepetitionType();
+  return repetition_type == FieldRepetitionType::REPEATED ||
+      repetition_type == FieldRepetitionType::OPTIONAL;
+}
+
+void ParquetColumn::EncodeLevels(const LevelRuns& levels,
+                                 size_t first_level, size_t num_levels,
                                  vector<uint8_t>* output_vector,
                                  uint16_t max_level) {
   CHECK_NOTNULL(output_vector);
+  CHECK_LE(first_level + num_levels, levels.size());
   int max_buffer_size =
-      impala::RleEncoder::MaxBufferSize(level_vector.size(),
-                                        max_level);
+      impala::RleEncoder::MaxBufferSize(num_levels, max_level);
   boost::shared_array<uint8_t> output_buffer(new uint8_t[max_buffer_size]);
   impala::RleEncoder encoder(output_buffer.get(), max_buffer_size, max_level);
-  VLOG(2) << "\tLevels size: " << level_vector.size();
-  for (uint8_t level : level_vector) {
-    VLOG(3) << "\t\t" << to_string(level);
-    CHECK(encoder.Put(level));
-  }
+  VLOG(2) << "\tLevels size: " << num_levels;
+  levels.ForEachRun(first_level, num_levels,
+                    [&encoder] (uint8_t level, size_t count) {
+                      VLOG(3) << "\t\t" << count << " x " << to_string(level);
+                      CHECK(encoder.PutRun(level, count));
+                    });
   encoder.Flush();
   uint32_t num_bytes = encoder.len();
   VLOG(2) << "\tLevels occupy " << num_bytes
@@ -335,12 +659,14 @@ void ParquetColumn::EncodeLevels(const vector<uint8_t>& level_vector,
 }
 
 void ParquetColumn::EncodeRepetitionLevels(
+    const DataPageRange& page,
     vector<uint8_t>* encoded_repetition_levels) {
   CHECK_NOTNULL(encoded_repetition_levels);
   encoded_repetition_levels->clear();
-  if (getFieldRepetitionType() == FieldRepetitionType::REPEATED) {
+  if (HasRepetitionLevels()) {
     VLOG(2) << "\tRepeated field, encoding repetition levels";
     EncodeLevels(repetition_levels_,
+                 page.first_level, page.num_levels,
                  encoded_repetition_levels,
                  max_repetition_level_);
   } else {
@@ -349,14 +675,14 @@ void ParquetColumn::EncodeRepetitionLevels(
 }
 
 void ParquetColumn::EncodeDefinitionLevels(
+    const DataPageRange& page,
     vector<uint8_t>* encoded_definition_levels) {
   CHECK_NOTNULL(encoded_definition_levels);
   encoded_definition_levels->clear();
-  FieldRepetitionType::type repetition_type = getFieldRepetitionType();
-  if (repetition_type == FieldRepetitionType::REPEATED ||
-      repetition_type == FieldRepetitionType::OPTIONAL) {
+  if (HasDefinitionLevels()) {
     VLOG(2) << "\tRepeated or optional field, encoding definition levels";
     EncodeLevels(definition_levels_,
+                 page.first_level, page.num_levels,
                  encoded_definition_levels,
                  max_definition_level_);
   } else {
@@ -364,121 +690,625 @@ void ParquetColumn::EncodeDefinitionLevels(
   }
 }
 
+void ParquetColumn::ComputeDataPages(vector<DataPageRange>* pages) const {
+  CHECK_NOTNULL(pages);
+  pages->clear();
+  DataPageRange page = {0, 0, 0, 0, 0, 0, 0, 0};
+  for (uint32_t i = 0; i < num_records_; ++i) {
+    page.num_records++;
+    page.num_levels += RecordLevelEnd(i) - RecordLevelStart(i);
+    page.data_size += recordSize(i);
+    if (page.data_size >= data_page_size_) {
+      pages->push_back(page);
+      DataPageRange next_page = {i + 1, 0,
+                                 page.first_level + page.num_levels, 0,
+                                 page.data_offset + page.data_size, 0,
+                                 0, 0};
+      page = next_page;
+    }
+  }
+  if (page.num_records > 0 || pages->empty()) {
+    pages->push_back(page);
+  }
+  // Values are only present where the definition level is at its
+  // max; anything lower is a null.  Without definition levels,
+  // there are no nulls.
+  size_t first_value = 0;
+  for (DataPageRange& p : *pages) {
+    p.first_value = first_value;
+    p.num_values = HasDefinitionLevels() ?
+        definition_levels_.Count(p.first_level, p.num_levels,
+                                 max_definition_level_) :
+        p.num_levels;
+    first_value += p.num_values;
+  }
+}
+
+uint64_t ParquetColumn::EstimatedLevelSizeInBytes(size_t num_levels) const {
+  // The bit widths the level encoder uses; see EncodeLevels.
+  int bits_per_level = 0;
+  if (HasRepetitionLevels()) {
+    bits_per_level += impala::RleEncoder::BitWidth(max_repetition_level_);
+  }
+  if (HasDefinitionLevels()) {
+    bits_per_level += impala::RleEncoder::BitWidth(max_definition_level_);
+  }
+  return ((uint64_t)num_levels * bits_per_level + 7) / 8;
+}
+
+uint64_t ParquetColumn::CumulativeSizeInBytes(uint64_t record_index) const {
+  LOG_IF(FATAL, record_index >= num_records_) <<
+      "record_index passed into CumulativeSizeInBytes was too large: " <<
+      record_index;
+  return RecordDataEnd(record_index) +
+      EstimatedLevelSizeInBytes(RecordLevelEnd(record_index));
+}
+
+uint64_t ParquetColumn::EstimatedSizeInBytes() const {
+  if (Children().size() != 0 || num_records_ == 0) {
+    return 0;
+  }
+  return CumulativeSizeInBytes(num_records_ - 1);
+}
+
 size_t ParquetColumn::ColumnDataSizeInBytes() {
   if (Children().size() != 0) {
     return 0;
   }
 
-  if (data_type_ != Type::BYTE_ARRAY) {
-    return bytes_per_datum_ * num_datums_;
-  }
+  return data_buffer_.Size();
+}
 
-  size_t record_size_accum = 0;
-  for (auto r : record_metadata) {
-    record_size_accum += (r.byte_end - r.byte_begin);
-  }
-  return record_size_accum;
+void ParquetColumn::Flush(ParquetSink* sink) {
+  CHECK_NOTNULL(sink);
+  EncodeColumnChunk();
+  vector<struct iovec> iovecs;
+  GetColumnChunkIovecs(sink->Tell(), &iovecs);
+  LOG_IF(FATAL, !sink->Write(iovecs))
+      << "Could not write column chunk for " << FullSchemaPath();
 }
 
-void ParquetColumn::Flush(int fd,
-                          TCompactProtocol* protocol) {
-  LOG_IF(FATAL, getEncoding() != Encoding::PLAIN)
-    << "Encoding can only be plain at this time.";
-  LOG_IF(FATAL, getCompressionCodec() != CompressionCodec::UNCOMPRESSED)
-    << "Compression is not supported at this time.";
+void ParquetColumn::EncodeColumnChunk() {
+  switch (getEncoding()) {
+    case Encoding::PLAIN:
+    case Encoding::PLAIN_DICTIONARY:
+    case Encoding::RLE_DICTIONARY:
+      break;
+    case Encoding::DELTA_BINARY_PACKED:
+      LOG_IF(FATAL, getType() != parquet::Type::INT32 &&
+             getType() != parquet::Type::INT64)
+        << "DELTA_BINARY_PACKED is only for INT32 and INT64 columns: "
+        << FullSchemaPath();
+      break;
+    case Encoding::BYTE_STREAM_SPLIT:
+      LOG_IF(FATAL, getType() != parquet::Type::FLOAT &&
+             getType() != parquet::Type::DOUBLE)
+        << "BYTE_STREAM_SPLIT is only for FLOAT and DOUBLE columns: "
+        << FullSchemaPath();
+      break;
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+    case Encoding::DELTA_BYTE_ARRAY:
+      LOG_IF(FATAL, getType() != parquet::Type::BYTE_ARRAY)
+        << parquet::_Encoding_VALUES_TO_NAMES.at(getEncoding())
+        << " is only for BYTE_ARRAY columns: " << FullSchemaPath();
+      break;
+    default:
+      LOG(FATAL) << "Unsupported encoding: "
+                 << parquet::_Encoding_VALUES_TO_NAMES.at(getEncoding());
+  }
   LOG_IF(FATAL, Children().size() != 0)  <<
-      "Flush called on container column";
+      "EncodeColumnChunk called on container column";
 
-  column_write_offset_ = lseek(fd, 0, SEEK_CUR);
-  VLOG(2) << "Inside flush for " << FullSchemaPath();
-  size_t column_data_size = ColumnDataSizeInBytes();
-  VLOG(2) << "\tData size: " << column_data_size << " bytes.";
+  VLOG(2) << "Encoding column chunk for " << FullSchemaPath();
+  VLOG(2) << "\tData size: " << ColumnDataSizeInBytes() << " bytes.";
   VLOG(2) << "\tNumber of records for this flush: " <<  NumRecords();
-  VLOG(2) << "\tFile offset: " << column_write_offset_;
+
+  vector<DataPageRange> pages;
+  ComputeDataPages(&pages);
+  VLOG(2) << "\tNumber of data pages: " << pages.size();
+
+  // Page headers are serialized into memory with a protocol of our
+  // own, so that encoding doesn't share any state with other columns.
+  // encoded_pages_ keeps its capacity from the last chunk.
+  encoded_pages_.clear();
+  encoded_segments_.clear();
+  uncompressed_bytes_ = 0;
+  compressed_bytes_ = 0;
+  dictionary_page_bytes_ = 0;
+  page_locations_.clear();
+  column_index_ = parquet::ColumnIndex();
+  has_column_index_ = getType() != parquet::Type::INT96;
+  chunk_dictionary_encoded_ = IsDictionaryEncoded();
+  if (chunk_dictionary_encoded_) {
+    CHECK_EQ(dictionary_indices_.size(),
+             pages.back().first_value + pages.back().num_values)
+        << "Every value needs a dictionary index";
+    EncodeDictionaryPage(header_protocol_.get(), header_buffer_.get());
+  }
+  for (const DataPageRange& page : pages) {
+    EncodeDataPage(page, header_protocol_.get(), header_buffer_.get());
+  }
+  ComputeBoundaryOrder();
+  // A dictionary holds each distinct value once, so it counts them
+  // for free.
+  chunk_statistics_ = statistics_.ToThrift(
+      chunk_dictionary_encoded_ ? dictionary_.NumEntries() : -1);
+  num_data_pages_ = pages.size();
+  VLOG(2) << "\tTotal uncompressed bytes: " << uncompressed_bytes_;
+  VLOG(2) << "\tTotal compressed bytes: " << compressed_bytes_;
+}
+
+void ParquetColumn::GetColumnChunkIovecs(off_t file_offset,
+                                         vector<struct iovec>* iovecs) {
+  CHECK_NOTNULL(iovecs);
+  column_write_offset_ = file_offset;
+  for (const EncodedSegment& segment : encoded_segments_) {
+    if (segment.from_data_buffer) {
+      data_buffer_.GetIovecs(segment.offset, segment.length, iovecs);
+    } else {
+      struct iovec iov;
+      iov.iov_base = encoded_pages_.data() + segment.offset;
+      iov.iov_len = segment.length;
+      iovecs->push_back(iov);
+    }
+  }
+}
+
+void ParquetColumn::WriteColumnChunk(PositionedWriter* writer,
+                                     off_t file_offset) {
+  CHECK_NOTNULL(writer);
+  vector<struct iovec> iovecs;
+  GetColumnChunkIovecs(file_offset, &iovecs);
+  VLOG(2) << "Writing column chunk for " << FullSchemaPath()
+          << " at file offset " << column_write_offset_;
+  ssize_t written = writer->WriteAt(file_offset, &iovecs);
+  if (written != compressed_bytes_) {
+    if (written == -1) {
+      LOG(ERROR) << strerror(errno);
+    }
+    LOG(FATAL) << "Did not write correct number of bytes: " << written
+               << "/" << compressed_bytes_;
+  }
+  VLOG(2) << "\tColumn chunk bytes written: " << written;
+}
+
+size_t ParquetColumn::GetBloomFilterIovecs(vector<struct iovec>* iovecs) {
+  CHECK_NOTNULL(iovecs);
+  CHECK(bloom_filter_) << FullSchemaPath() << " has no Bloom filter";
+  parquet::BloomFilterAlgorithm algorithm;
+  algorithm.__set_BLOCK(parquet::SplitBlockAlgorithm());
+  parquet::BloomFilterHash hash;
+  hash.__set_XXHASH(parquet::XxHash());
+  parquet::BloomFilterCompression compression;
+  compression.__set_UNCOMPRESSED(parquet::Uncompressed());
+  parquet::BloomFilterHeader header;
+  header.__set_numBytes(bloom_filter_->NumBytes());
+  header.__set_algorithm(algorithm);
+  header.__set_hash(hash);
+  header.__set_compression(compression);
+
+  header_buffer_->resetBuffer();
+  header.write(header_protocol_.get());
+  uint8_t* header_bytes;
+  uint32_t header_length;
+  header_buffer_->getBuffer(&header_bytes, &header_length);
+  bloom_filter_header_.assign(header_bytes, header_bytes + header_length);
+
+  struct iovec iov;
+  iov.iov_base = bloom_filter_header_.data();
+  iov.iov_len = bloom_filter_header_.size();
+  iovecs->push_back(iov);
+  iov.iov_base = const_cast<uint8_t*>(bloom_filter_->Bitset());
+  iov.iov_len = bloom_filter_->NumBytes();
+  iovecs->push_back(iov);
+  return bloom_filter_header_.size() + bloom_filter_->NumBytes();
+}
+
+void ParquetColumn::AddEncodedSegment(bool from_data_buffer,
+                                      size_t offset, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  if (!encoded_segments_.empty()) {
+    EncodedSegment& last = encoded_segments_.back();
+    if (last.from_data_buffer == from_data_buffer &&
+        last.offset + last.length == offset) {
+      last.length += length;
+      return;
+    }
+  }
+  EncodedSegment segment = {from_data_buffer, offset, length};
+  encoded_segments_.push_back(segment);
+}
+
+void ParquetColumn::EncodeDataPage(const DataPageRange& page,
+                                   TCompactProtocol* protocol,
+                                   TMemoryBuffer* header_buffer) {
+  VLOG(2) << "\tData page of " << page.num_records << " records at data offset "
+          << page.data_offset;
   vector<uint8_t> encoded_repetition_levels, encoded_definition_levels;
-  EncodeRepetitionLevels(&encoded_repetition_levels);
-  EncodeDefinitionLevels(&encoded_definition_levels);
+  EncodeRepetitionLevels(page, &encoded_repetition_levels);
+  EncodeDefinitionLevels(page, &encoded_definition_levels);
   uint32_t repetition_level_size = encoded_repetition_levels.size();
   uint32_t definition_level_size = encoded_definition_levels.size();
 
-  uncompressed_bytes_ = column_data_size + repetition_level_size +
+  // PLAIN values are written straight from the data buffer; any other
+  // encoding is built in encoded_values.  Dictionary encoded pages
+  // hold the values' indices in place of the values themselves.
+  Encoding::type page_encoding = DataPageEncoding();
+  bool values_in_data_buffer = page_encoding == Encoding::PLAIN;
+  vector<uint8_t> encoded_values;
+  if (chunk_dictionary_encoded_) {
+    dictionary_.EncodeIndices(dictionary_indices_, page.first_value,
+                              page.num_values, &encoded_values);
+  } else if (!values_in_data_buffer) {
+    EncodeValues(page, &encoded_values);
+  }
+  size_t values_size = values_in_data_buffer ?
+      page.data_size : encoded_values.size();
+
+  uint32_t page_bytes = values_size + repetition_level_size +
                         definition_level_size;
   // We add 8 to this for the two ints at that indicate the length of
   // the rep & def levels.
   if (repetition_level_size > 0) {
-    uncompressed_bytes_ += 4;
+    page_bytes += 4;
   }
   if (definition_level_size > 0) {
-    uncompressed_bytes_ += 4;
+    page_bytes += 4;
+  }
+
+  // Compression codecs need the whole page body in one buffer, so
+  // gather the levels & data before compressing them.
+  bool compressed = getCompressionCodec() != CompressionCodec::UNCOMPRESSED;
+  vector<uint8_t> compressed_page;
+  uint32_t compressed_page_bytes = page_bytes;
+  if (compressed) {
+    vector<uint8_t> page_body;
+    page_body.reserve(page_bytes);
+    if (repetition_level_size > 0) {
+      AppendLevels(encoded_repetition_levels, &page_body);
+    }
+    if (definition_level_size > 0) {
+      AppendLevels(encoded_definition_levels, &page_body);
+    }
+    if (!values_in_data_buffer) {
+      page_body.insert(page_body.end(), encoded_values.begin(),
+                       encoded_values.end());
+    } else {
+      size_t levels_size = page_body.size();
+      page_body.resize(levels_size + page.data_size);
+      data_buffer_.CopyTo(page.data_offset, page.data_size,
+                          page_body.data() + levels_size);
+    }
+    Compress(getCompressionCodec(), getCompressionLevel(),
+             page_body.data(), page_body.size(), &compressed_page);
+    compressed_page_bytes = compressed_page.size();
   }
 
   DataPageHeader data_header;
   PageHeader page_header;
   page_header.__set_type(PageType::DATA_PAGE);
 
-  page_header.__set_uncompressed_page_size(uncompressed_bytes_);
-  // Obviously, this is a stop gap until compression support is added.
-  page_header.__set_compressed_page_size(uncompressed_bytes_);
-  data_header.__set_num_values(definition_levels_.size());
-  data_header.__set_encoding(Encoding::PLAIN);
+  page_header.__set_uncompressed_page_size(page_bytes);
+  page_header.__set_compressed_page_size(compressed_page_bytes);
+  data_header.__set_num_values(page.num_levels);
+  data_header.__set_encoding(page_encoding);
   // NB: For some reason, the following two must be set, even though
   // they can default to PLAIN, even for required/nonrepeating fields.
   // I'm not sure if it's part of the Parquet spec or a bug in
   // parquet-dump.
   data_header.__set_definition_level_encoding(Encoding::RLE);
   data_header.__set_repetition_level_encoding(Encoding::RLE);
+  data_header.__set_statistics(PageStatistics(page));
   page_header.__set_data_page_header(data_header);
+  header_buffer->resetBuffer();
   uint32_t page_header_size = page_header.write(protocol);
-  uncompressed_bytes_ += page_header_size;
   VLOG(2) << "\tPage header size: " << page_header_size;
-  VLOG(2) << "\tTotal uncompressed bytes: " << uncompressed_bytes_;
+  // The page starts where the chunk encoded so far ends.
+  AddToPageIndex(page, compressed_bytes_,
+                 page_header_size + compressed_page_bytes,
+                 data_header.statistics);
+  uncompressed_bytes_ += page_header_size + page_bytes;
+  compressed_bytes_ += page_header_size + compressed_page_bytes;
 
-  if (repetition_level_size > 0) {
-    FlushLevels(fd, encoded_repetition_levels);
+  size_t page_start = encoded_pages_.size();
+  uint8_t* header_bytes;
+  uint32_t header_length;
+  header_buffer->getBuffer(&header_bytes, &header_length);
+  CHECK_EQ(header_length, page_header_size);
+  encoded_pages_.insert(encoded_pages_.end(), header_bytes,
+                        header_bytes + header_length);
+
+  if (compressed) {
+    encoded_pages_.insert(encoded_pages_.end(), compressed_page.begin(),
+                          compressed_page.end());
+    AddEncodedSegment(false, page_start, encoded_pages_.size() - page_start);
+    return;
   }
 
+  if (repetition_level_size > 0) {
+    AppendLevels(encoded_repetition_levels, &encoded_pages_);
+  }
   if (definition_level_size > 0) {
-    FlushLevels(fd, encoded_definition_levels);
+    AppendLevels(encoded_definition_levels, &encoded_pages_);
   }
+  if (!values_in_data_buffer) {
+    encoded_pages_.insert(encoded_pages_.end(), encoded_values.begin(),
+                          encoded_values.end());
+    AddEncodedSegment(false, page_start, encoded_pages_.size() - page_start);
+    return;
+  }
+  AddEncodedSegment(false, page_start, encoded_pages_.size() - page_start);
+  AddEncodedSegment(true, page.data_offset, page.data_size);
+}
 
-  VLOG(2) << "\tData size: " << column_data_size;
-  ssize_t written = write(fd, data_buffer_.get(),
-                          column_data_size);
-  if (written != column_data_size) {
-    if (written == -1) {
-      LOG(ERROR) << strerror(errno);
+Encoding::type ParquetColumn::DataPageEncoding() const {
+  if (encoding_ == Encoding::PLAIN_DICTIONARY ||
+      encoding_ == Encoding::RLE_DICTIONARY) {
+    return chunk_dictionary_encoded_ ? encoding_ : Encoding::PLAIN;
+  }
+  return encoding_;
+}
+
+// static
+template <typename Callback>
+void ParquetColumn::ForEachByteArray(const vector<struct iovec>& iovecs,
+                                     const Callback& callback) {
+  for (const struct iovec& iov : iovecs) {
+    const uint8_t* data = (const uint8_t*)iov.iov_base;
+    const uint8_t* end = data + iov.iov_len;
+    while (data < end) {
+      uint32_t length;
+      memcpy(&length, data, sizeof(length));
+      callback(data + sizeof(length), length);
+      data += sizeof(length) + length;
     }
-    LOG(FATAL) << "Did not write correct number of bytes: " << written << "/" << column_data_size;
   }
-  VLOG(2) << "\tData bytes written: " << written;
-  VLOG(2) << "\tFinal offset after write: " << lseek(fd, 0, SEEK_CUR);
 }
 
-void ParquetColumn::FlushLevels(int fd, const vector<uint8_t>& levels_vector) {
-  VLOG(3) << "\tOffset before writing size: " << lseek(fd, 0, SEEK_CUR);
-  uint32_t num_elements = levels_vector.size();
-  write(fd, &num_elements, 4);
-  VLOG(3) << "\tOffset after writing size: " << lseek(fd, 0, SEEK_CUR);
-  size_t bytes_written = write(fd, levels_vector.data(), num_elements);
+void ParquetColumn::EncodeValues(const DataPageRange& page,
+                                 vector<uint8_t>* output) const {
+  // Records, and so values, never straddle the data buffer's chunks,
+  // so each piece holds whole values.
+  vector<struct iovec> iovecs;
+  data_buffer_.GetIovecs(page.data_offset, page.data_size, &iovecs);
+  switch (DataPageEncoding()) {
+    case Encoding::DELTA_BINARY_PACKED:
+      if (getType() == parquet::Type::INT32) {
+        DeltaBinaryPackedEncoder<int32_t> encoder;
+        for (const struct iovec& iov : iovecs) {
+          encoder.Put((const int32_t*)iov.iov_base,
+                      iov.iov_len / sizeof(int32_t));
+        }
+        encoder.Flush(output);
+      } else {
+        DeltaBinaryPackedEncoder<int64_t> encoder;
+        for (const struct iovec& iov : iovecs) {
+          encoder.Put((const int64_t*)iov.iov_base,
+                      iov.iov_len / sizeof(int64_t));
+        }
+        encoder.Flush(output);
+      }
+      break;
+    case Encoding::BYTE_STREAM_SPLIT: {
+      // Every stream is as long as the page has values.
+      size_t num_values = page.data_size / bytes_per_datum_;
+      output->resize(page.data_size);
+      size_t first_value = 0;
+      for (const struct iovec& iov : iovecs) {
+        size_t n = iov.iov_len / bytes_per_datum_;
+        SplitByteStreams((const uint8_t*)iov.iov_base, n, bytes_per_datum_,
+                         num_values, output->data() + first_value);
+        first_value += n;
+      }
+      break;
+    }
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY: {
+      DeltaLengthByteArrayEncoder encoder;
+      ForEachByteArray(iovecs, [&encoder] (const uint8_t* value,
+                                           uint32_t length) {
+          encoder.Put(value, length);
+        });
+      encoder.Flush(output);
+      break;
+    }
+    case Encoding::DELTA_BYTE_ARRAY: {
+      DeltaByteArrayEncoder encoder;
+      ForEachByteArray(iovecs, [&encoder] (const uint8_t* value,
+                                           uint32_t length) {
+          encoder.Put(value, length);
+        });
+      encoder.Flush(output);
+      break;
+    }
+    default:
+      LOG(FATAL) << "Can't encode values as "
+                 << parquet::_Encoding_VALUES_TO_NAMES.at(DataPageEncoding());
+  }
+  VLOG(2) << "\t" << page.num_values << " values occupy " << output->size()
+          << " bytes encoded, " << page.data_size << " PLAIN";
+}
 
-  if (bytes_written != num_elements) {
-    LOG(WARNING) << "Only " << bytes_written << " of "
-                 << num_elements
-                 << " for repetition levels were written.";
+void ParquetColumn::AddToPageIndex(const DataPageRange& page,
+                                   uint64_t page_offset, uint32_t page_bytes,
+                                   const parquet::Statistics& statistics) {
+  parquet::PageLocation location;
+  location.__set_offset(page_offset);
+  location.__set_compressed_page_size(page_bytes);
+  location.__set_first_row_index(page.first_record);
+  page_locations_.push_back(location);
+
+  bool null_page = page.num_values == 0;
+  if (!null_page && !statistics.__isset.min_value) {
+    has_column_index_ = false;
+  }
+  if (!has_column_index_) {
+    return;
   }
-  VLOG(3) << "\tOffset after levels written: " << lseek(fd, 0, SEEK_CUR);
+  // Null pages have no min or max, but still need an entry.
+  column_index_.null_pages.push_back(null_page);
+  column_index_.min_values.push_back(null_page ? "" : statistics.min_value);
+  column_index_.max_values.push_back(null_page ? "" : statistics.max_value);
+  column_index_.null_counts.push_back(statistics.null_count);
+}
+
+void ParquetColumn::ComputeBoundaryOrder() {
+  if (!has_column_index_) {
+    return;
+  }
+  // Pages are in order if their mins and maxes both are, ignoring
+  // null pages.  Readers can then binary search them.
+  bool ascending = true;
+  bool descending = true;
+  int previous = -1;
+  for (int i = 0; i < column_index_.null_pages.size(); ++i) {
+    if (column_index_.null_pages[i]) {
+      continue;
+    }
+    if (previous != -1) {
+      int min_order = ColumnStatistics::Compare(
+          getType(), column_index_.min_values[previous],
+          column_index_.min_values[i]);
+      int max_order = ColumnStatistics::Compare(
+          getType(), column_index_.max_values[previous],
+          column_index_.max_values[i]);
+      ascending = ascending && min_order <= 0 && max_order <= 0;
+      descending = descending && min_order >= 0 && max_order >= 0;
+    }
+    previous = i;
+  }
+  // A chunk with a single page counts as ascending.
+  column_index_.__set_boundary_order(
+      ascending ? parquet::BoundaryOrder::ASCENDING :
+      (descending ? parquet::BoundaryOrder::DESCENDING :
+       parquet::BoundaryOrder::UNORDERED));
+  column_index_.__isset.null_pages = true;
+  column_index_.__isset.min_values = true;
+  column_index_.__isset.max_values = true;
+  column_index_.__isset.null_counts = true;
+}
+
+parquet::Statistics ParquetColumn::PageStatistics(
+    const DataPageRange& page) const {
+  // Pages are only known once the chunk is encoded, so their
+  // statistics are computed here, from the PLAIN values in the data
+  // buffer, which are there whatever the page's encoding.  Records
+  // never span buffer chunks, so each iovec holds whole values.
+  ColumnStatistics page_statistics(getType());
+  page_statistics.AddNulls(page.num_levels - page.num_values);
+  vector<struct iovec> iovecs;
+  data_buffer_.GetIovecs(page.data_offset, page.data_size, &iovecs);
+  for (const struct iovec& iov : iovecs) {
+    const uint8_t* values = static_cast<const uint8_t*>(iov.iov_base);
+    if (getType() == parquet::Type::BYTE_ARRAY) {
+      page_statistics.AddPlainByteArrays(values, iov.iov_len);
+    } else {
+      page_statistics.AddValues(values, iov.iov_len / bytes_per_datum_);
+    }
+  }
+  return page_statistics.ToThrift();
+}
+
+void ParquetColumn::EncodeDictionaryPage(TCompactProtocol* protocol,
+                                         TMemoryBuffer* header_buffer) {
+  const vector<uint8_t>& dictionary = dictionary_.PlainEncodedDictionary();
+  VLOG(2) << "\tDictionary page of " << dictionary_.NumEntries()
+          << " entries, " << dictionary.size() << " bytes";
+  vector<uint8_t> compressed_dictionary;
+  const vector<uint8_t>* page_body = &dictionary;
+  if (getCompressionCodec() != CompressionCodec::UNCOMPRESSED) {
+    Compress(getCompressionCodec(), getCompressionLevel(),
+             dictionary.data(), dictionary.size(), &compressed_dictionary);
+    page_body = &compressed_dictionary;
+  }
+
+  DictionaryPageHeader dictionary_header;
+  dictionary_header.__set_num_values(dictionary_.NumEntries());
+  // Format version 1 files label the dictionary page PLAIN_DICTIONARY
+  // too; RLE_DICTIONARY goes with a PLAIN dictionary page.
+  dictionary_header.__set_encoding(
+      getEncoding() == Encoding::PLAIN_DICTIONARY ?
+      Encoding::PLAIN_DICTIONARY : Encoding::PLAIN);
+  PageHeader page_header;
+  page_header.__set_type(PageType::DICTIONARY_PAGE);
+  page_header.__set_uncompressed_page_size(dictionary.size());
+  page_header.__set_compressed_page_size(page_body->size());
+  page_header.__set_dictionary_page_header(dictionary_header);
+  header_buffer->resetBuffer();
+  uint32_t page_header_size = page_header.write(protocol);
+  uncompressed_bytes_ += page_header_size + dictionary.size();
+  compressed_bytes_ += page_header_size + page_body->size();
+  dictionary_page_bytes_ = page_header_size + page_body->size();
+
+  size_t page_start = encoded_pages_.size();
+  uint8_t* header_bytes;
+  uint32_t header_length;
+  header_buffer->getBuffer(&header_bytes, &header_length);
+  CHECK_EQ(header_length, page_header_size);
+  encoded_pages_.insert(encoded_pages_.end(), header_bytes,
+                        header_bytes + header_length);
+  encoded_pages_.insert(encoded_pages_.end(), page_body->begin(),
+                        page_body->end());
+  AddEncodedSegment(false, page_start, encoded_pages_.size() - page_start);
+}
+
+parquet::OffsetIndex ParquetColumn::ParquetOffsetIndex() const {
+  CHECK_GE(column_write_offset_, 0) << "Column chunk hasn't been written";
+  vector<parquet::PageLocation> locations(page_locations_);
+  for (parquet::PageLocation& location : locations) {
+    location.offset += column_write_offset_;
+  }
+  parquet::OffsetIndex offset_index;
+  offset_index.__set_page_locations(locations);
+  return offset_index;
+}
+
+bool ParquetColumn::HasColumnIndex() const {
+  return has_column_index_;
+}
+
+parquet::ColumnIndex ParquetColumn::ParquetColumnIndex() const {
+  CHECK(has_column_index_) << "Column chunk of " << FullSchemaPath()
+                           << " has no column index";
+  return column_index_;
+}
+
+void ParquetColumn::AppendLevels(const vector<uint8_t>& levels_vector,
+                                 vector<uint8_t>* output) {
+  uint32_t num_elements = levels_vector.size();
+  const uint8_t* length_bytes = (const uint8_t*)&num_elements;
+  output->insert(output->end(), length_bytes, length_bytes + 4);
+  output->insert(output->end(), levels_vector.begin(), levels_vector.end());
 }
 
 ColumnMetaData ParquetColumn::ParquetColumnMetaData() const {
   ColumnMetaData column_metadata;
   column_metadata.__set_type(getType());
-  column_metadata.__set_encodings({getEncoding()});
+  if (chunk_dictionary_encoded_) {
+    vector<Encoding::type> encodings = {getEncoding(), Encoding::RLE};
+    if (getEncoding() == Encoding::RLE_DICTIONARY) {
+      // The dictionary page itself is PLAIN.
+      encodings.push_back(Encoding::PLAIN);
+    }
+    column_metadata.__set_encodings(encodings);
+  } else {
+    column_metadata.__set_encodings({DataPageEncoding()});
+  }
   column_metadata.__set_codec(getCompressionCodec());
-  column_metadata.__set_num_values(definition_levels_.size());
+  column_metadata.__set_num_values(num_levels_);
   column_metadata.__set_total_uncompressed_size(uncompressed_bytes_);
-  column_metadata.__set_total_compressed_size(uncompressed_bytes_);
-  column_metadata.__set_data_page_offset(column_write_offset_);
+  column_metadata.__set_total_compressed_size(compressed_bytes_);
+  if (chunk_dictionary_encoded_) {
+    // The dictionary page comes first in the column chunk.
+    column_metadata.__set_dictionary_page_offset(column_write_offset_);
+    column_metadata.__set_data_page_offset(column_write_offset_ +
+                                           dictionary_page_bytes_);
+  } else {
+    column_metadata.__set_data_page_offset(column_write_offset_);
+  }
   column_metadata.__set_path_in_schema(column_name_);
+  column_metadata.__set_statistics(chunk_statistics_);
   return column_metadata;
 }
 }  // namespace parquet_file
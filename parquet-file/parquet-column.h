@@ -2,8 +2,21 @@
 
 #include "./parquet_types.h"
 #include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 #include <boost/shared_array.hpp>
 #include <glog/logging.h>
+#include <parquet-file/bloom-filter.h>
+#include <parquet-file/byte-stream-split.h>
+#include <parquet-file/chunked-buffer.h>
+#include <parquet-file/column-statistics.h>
+#include <parquet-file/compression.h>
+#include <parquet-file/delta-encoder.h>
+#include <parquet-file/dictionary-encoder.h>
+#include <parquet-file/level-runs.h>
+#include <parquet-file/parquet-sink.h>
+#include <parquet-file/positioned-writer.h>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,30 +30,43 @@ using parquet::DataPageHeader;
 using parquet::Encoding;
 using parquet::FieldRepetitionType;
 using parquet::Type;
+using std::function;
 using std::string;
 using std::to_string;
 using std::tuple;
 using std::vector;
 
+// Default amount of column data, in bytes, after which a column chunk
+// is split into another data page.
+const uint32_t kDataBytesPerPage = 1024 * 1024;
+
 namespace parquet_file {
 
-struct RecordMetadata {
-  // The index in the rep level vector where this record's repetition
-  // level starts.
-  size_t repetition_level_index_start; 
-  // The index in the rep level vector where this record's repetition
-  // level ends (not inclusive).
-  size_t repetition_level_index_end;
-  // The index in the def level vector where this record's definition
-  // level starts.
-  size_t definition_level_index_start;
-  // The index in the def level vector where this record's definition
-  // level ends (not inclusive).
-  size_t definition_level_index_end;
-  uint8_t* byte_begin;
-  uint8_t* byte_end;
+// A range of a column's records that are written as one data page.
+// Pages always start and end on record boundaries.
+struct DataPageRange {
+  uint32_t first_record;
+  uint32_t num_records;
+  // Range of the rep & def level vectors for the records.  Both
+  // vectors have one entry per value (including nulls), so one range
+  // covers both.
+  size_t first_level;
+  size_t num_levels;
+  // Range of the data buffer for the records.
+  size_t data_offset;
+  size_t data_size;
+  // Range of the non-null values in the records, which is also the
+  // range of their dictionary indices.
+  size_t first_value;
+  size_t num_values;
 };
 
+// Picks which shard a record added to a column goes to, given the
+// record's index among all those added to the column, and its data:
+// length bytes at data, or nullptr for a null.
+typedef function<int(uint64_t record_index, const uint8_t* data,
+                     size_t length)> RecordRouter;
+
 // ParquetColumn represents a Parquet Column of data.  ParquetColumn
 // can contain children, which is how an, for example, Apache Avro
 // message could be represented.
@@ -52,7 +78,10 @@ class ParquetColumn {
   // column (repeated, required, etc), and encoding & compression are
   // as they are in Parquet.  max_{repetition, definition}_level
   // represents the max level of this column in the schema tree (it's
-  // used for setting the repetition & definition levels)
+  // used for setting the repetition & definition levels).  If
+  // data_buffer is provided, it is used for the first
+  // data_buffer_size_in_bytes of column data; more space is allocated
+  // as needed after that.
   ParquetColumn(const vector<string>& column_name,
                 parquet::Type::type data_type,
                 uint16_t max_repetition_level,
@@ -67,6 +96,11 @@ class ParquetColumn {
   ParquetColumn(const vector<string>& column_name,
                 FieldRepetitionType::type repetition_type);
 
+  // Returns a new column with the same name, type, levels, encoding
+  // and compression settings as this one, but no data or children.
+  // The caller owns the new column.
+  ParquetColumn* CloneWithoutData() const;
+
   // Set/get the children of this column
   void SetChildren(const vector<ParquetColumn*>& children);
   void AddChild(ParquetColumn* child);
@@ -83,6 +117,37 @@ class ParquetColumn {
 
   CompressionCodec::type getCompressionCodec() const;
 
+  // Sets the level the compression codec uses for this column, e.g.
+  // a high zstd level for cold columns.  Defaults to
+  // kCodecDefaultCompressionLevel, i.e. whatever the codec defaults to.
+  void setCompressionLevel(int compression_level);
+  int getCompressionLevel() const;
+
+  // Sets the amount of column data after which a new data page is
+  // started.  Defaults to kDataBytesPerPage.
+  void setDataPageSize(uint32_t data_page_size);
+  uint32_t getDataPageSize() const;
+
+  // Sets the size, in bytes, a column chunk's PLAIN encoded dictionary
+  // may grow to before the chunk gives up on dictionary encoding and
+  // is written PLAIN.  Only used by PLAIN_DICTIONARY and
+  // RLE_DICTIONARY columns.  Defaults to kMaxDictionaryPageSize.
+  void setDictionaryPageSizeLimit(uint32_t dictionary_page_size_limit);
+  uint32_t getDictionaryPageSizeLimit() const;
+
+  // Builds a Bloom filter of this column's values for every column
+  // chunk, sized to hold expected_distinct_values per chunk with a
+  // false positive probability of fpp.  Readers can probe it to skip
+  // chunks that can't contain a value.
+  void EnableBloomFilter(uint64_t expected_distinct_values,
+                         double fpp = kDefaultBloomFilterFpp);
+  bool HasBloomFilter() const;
+
+  // True if the data added since the last Reset() will be written
+  // dictionary encoded, i.e. the column uses a dictionary encoding and
+  // its dictionary hasn't outgrown the limit.
+  bool IsDictionaryEncoded() const;
+
   string Name() const;
 
   // A '.'-joined string of the path components (i.e. the names of
@@ -116,46 +181,234 @@ class ParquetColumn {
                 uint16_t current_definition_level,
                 uint32_t n);
 
+  // Sends the records added to this column straight to one of
+  // shard_columns, which have this column's schema, instead of keeping
+  // them: each goes to shard_columns[router(...)], and consecutive
+  // records bound for the same shard are added together.  Must be
+  // called before any records are added.
+  void RouteRecordsTo(const vector<ParquetColumn*>& shard_columns,
+                      const RecordRouter& router);
+  // Number of records sent to the shard columns so far.
+  uint64_t NumRoutedRecords() const { return num_routed_records_; }
+
   uint32_t NumRecords() const;
   uint32_t NumDatums() const;
-
-
-  // Flush this column via the protocol provided.
-  void Flush(int fd,
-             apache::thrift::protocol::TCompactProtocol* protocol);
+  // Number of data pages in the last encoded column chunk.
+  uint32_t NumDataPages() const;
+
+  // Discards all data, levels and record metadata in this column,
+  // e.g. after it has been flushed as part of a row group.  Buffers
+  // are kept for reuse.
+  void Reset();
+
+
+  // Encodes (and compresses) this column's data as a column chunk
+  // in memory, ready to be written by WriteColumnChunk.  Touches no
+  // state outside this column, so different columns can be encoded
+  // on different threads at the same time.
+  void EncodeColumnChunk();
+
+  // Appends iovecs covering the column chunk built by
+  // EncodeColumnChunk, in file order, and records file_offset as where
+  // the chunk starts.  The iovecs point into this column's buffers and
+  // are valid until the column is next encoded or reset.  This lets a
+  // whole row group go out in a single write.
+  void GetColumnChunkIovecs(off_t file_offset, vector<struct iovec>* iovecs);
+
+  // Appends iovecs covering the Bloom filter of the current column
+  // chunk, header first, as it's written to the file, and returns its
+  // size in bytes.  Like GetColumnChunkIovecs, the iovecs point into
+  // this column and are valid until it's next reset.  Only call this
+  // if HasBloomFilter().
+  size_t GetBloomFilterIovecs(vector<struct iovec>* iovecs);
+
+  // Size in bytes of the column chunk built by EncodeColumnChunk.
+  uint64_t EncodedSizeInBytes() const { return compressed_bytes_; }
+
+  // Writes the column chunk built by EncodeColumnChunk to writer at
+  // file_offset, which the caller has reserved EncodedSizeInBytes()
+  // bytes at.  Columns can write their chunks concurrently.
+  void WriteColumnChunk(PositionedWriter* writer, off_t file_offset);
+
+  // Encodes this column chunk and appends it to sink.
+  void Flush(ParquetSink* sink);
 
   // Generate a Parquet Thrift ColumnMetaData message for this column.
   ColumnMetaData ParquetColumnMetaData() const;
+  // The page index of the last encoded column chunk: where its data
+  // pages are and which records they start with, and their min, max
+  // and null counts.  The offset index is only valid once the chunk
+  // has been given its file offset.  A chunk has no column index, and
+  // HasColumnIndex() is false, if one of its pages has values but no
+  // min and max, e.g. INT96 values or only NaNs.
+  parquet::OffsetIndex ParquetOffsetIndex() const;
+  bool HasColumnIndex() const;
+  parquet::ColumnIndex ParquetColumnIndex() const;
   // Pretty printing method.
   string ToString() const;
   size_t ColumnDataSizeInBytes();
 
+  // Estimated number of bytes records 0 through record_index will
+  // take up once encoded: their data, plus their levels bit-packed.
+  // This is a running total, so the estimated size of any range of
+  // records is the difference of two calls.
+  uint64_t CumulativeSizeInBytes(uint64_t record_index) const;
+  // The same, for all the records in the column.
+  uint64_t EstimatedSizeInBytes() const;
+
   uint64_t recordSize(uint64_t record_index) const {
-    LOG_IF(FATAL, record_index >= record_metadata.size()) <<
+    LOG_IF(FATAL, record_index >= num_records_) <<
         "record_index passed into recordSize was too large: " << record_index;
-    const RecordMetadata& r = record_metadata[record_index];
-    return r.byte_end - r.byte_begin;
+    return RecordDataEnd(record_index) - RecordDataStart(record_index);
   }
 
  private:
-  // Writes entire vector to the file descriptor given.
-  void FlushLevels(int fd, const vector<uint8_t>& levels_vector);
+  // Where each record's levels and data are.  Records are contiguous
+  // and in order, so each one starts where the previous one ends.
+  // Levels are indexed like the level runs, and data by its offset in
+  // data_buffer_.
+  size_t RecordLevelEnd(uint64_t record_index) const {
+    // Without repetition, every record has exactly one level.
+    return HasRepetitionLevels() ?
+        record_level_ends_[record_index] : record_index + 1;
+  }
+  size_t RecordLevelStart(uint64_t record_index) const {
+    return record_index == 0 ? 0 : RecordLevelEnd(record_index - 1);
+  }
+  size_t RecordDataEnd(uint64_t record_index) const {
+    return implicit_data_offsets_ ?
+        (record_index + 1) * bytes_per_datum_ :
+        record_data_ends_[record_index];
+  }
+  size_t RecordDataStart(uint64_t record_index) const {
+    return record_index == 0 ? 0 : RecordDataEnd(record_index - 1);
+  }
 
-  // Helper method to encode a vector of 8-bit integers into an output
-  // buffer.  Used for repetition & definition level encoding.
-  void EncodeLevels(const vector<uint8_t>& level_vector,
+  // Routes n records to the shard columns.  Record i is length bytes
+  // at data + i * stride, or a null if data is nullptr.  add is called
+  // for each run of consecutive records that go to the same shard
+  // column, with the index of the run's first record and its length.
+  void RouteRecords(
+      const uint8_t* data, size_t stride, size_t length, uint32_t n,
+      const function<void(ParquetColumn*, uint32_t, uint32_t)>& add);
+
+  // Returns how many of n fixed-width values, up to n, can be added
+  // to the data buffer contiguously.  Always at least 1, in which
+  // case the buffer starts a new chunk.
+  uint32_t DatumsThatFitContiguously(uint32_t n) const;
+
+  // Splits the records in this column into data pages of roughly
+  // data_page_size_ bytes of data each.  There is always at least one
+  // page, even if the column has no records.
+  void ComputeDataPages(vector<DataPageRange>* pages) const;
+
+  // Encodes one data page (header, levels and data), compressing the
+  // levels and data if the column has a compression codec.  The page
+  // header is serialized with protocol, which must write to
+  // header_buffer.  Adds the page's size to uncompressed_bytes_ and
+  // compressed_bytes_.
+  void EncodeDataPage(const DataPageRange& page,
+                      apache::thrift::protocol::TCompactProtocol* protocol,
+                      apache::thrift::transport::TMemoryBuffer* header_buffer);
+
+  // Appends length bytes to the encoded column chunk.  If
+  // from_data_buffer is true, they are a reference to the bytes at
+  // offset in data_buffer_, otherwise to the bytes at offset in
+  // encoded_pages_.
+  void AddEncodedSegment(bool from_data_buffer, size_t offset, size_t length);
+
+  // Appends n levels to the level runs this column stores, and
+  // returns the index of the first one.
+  size_t AddLevels(uint16_t repetition_level, uint16_t definition_level,
+                   size_t n);
+
+  // Estimated size of num_levels levels once encoded.  Levels that
+  // aren't written count as nothing.
+  uint64_t EstimatedLevelSizeInBytes(size_t num_levels) const;
+
+  // Whether repetition & definition levels are written for this
+  // column, and so whether they're stored at all.
+  bool HasRepetitionLevels() const;
+  bool HasDefinitionLevels() const;
+
+  // Appends the length of levels_vector followed by its contents to
+  // output.
+  void AppendLevels(const vector<uint8_t>& levels_vector,
+                    vector<uint8_t>* output);
+
+  // Helper method to encode num_levels levels, starting at
+  // first_level in levels, into an output buffer.  Used for
+  // repetition & definition level encoding.
+  void EncodeLevels(const LevelRuns& levels,
+                    size_t first_level, size_t num_levels,
                     vector<uint8_t>* output_vector,
                     uint16_t max_level);
 
   // Following two methods call EncodeLevels with the right parameters
   // for encoding those specific level vectors (repetition or
-  // definition)
-  void EncodeRepetitionLevels(vector<uint8_t>* encoded_repetition_levels);
-  void EncodeDefinitionLevels(vector<uint8_t>* encoded_definition_levels);
+  // definition) for one data page.
+  void EncodeRepetitionLevels(const DataPageRange& page,
+                              vector<uint8_t>* encoded_repetition_levels);
+  void EncodeDefinitionLevels(const DataPageRange& page,
+                              vector<uint8_t>* encoded_definition_levels);
+
+  // Records a new record whose levels end at level_end and whose data
+  // ends at data_end.
+  void AddRecordMetadata(size_t level_end, size_t data_end);
+
+  // Records n new records of one fixed-width value each, whose levels
+  // start at level_start and whose data starts at data_start.
+  void AddFixedWidthRecordMetadata(size_t level_start, size_t data_start,
+                                   uint32_t n);
+
+  // Adds n values of value_length bytes each, starting at values, to
+  // the dictionary, if this column is being dictionary encoded.
+  void AddToDictionary(const uint8_t* values, uint32_t value_length,
+                       uint32_t n);
 
-  void AddRecordMetadata(size_t rep_level_start, size_t rep_level_end,
-                         size_t def_level_start, size_t def_level_end,
-                         uint8_t* start, uint8_t* end);
+  // Adds n values of value_length bytes each, starting at values, to
+  // the Bloom filter, if this column has one.
+  void AddToBloomFilter(const uint8_t* values, uint32_t value_length,
+                        uint32_t n);
+
+  // Stops dictionary encoding the current column chunk once its
+  // dictionary is larger than the limit.
+  void MaybeFallBackToPlainEncoding();
+
+  // The encoding of the values in the data pages of the column chunk
+  // being encoded: the column's encoding, unless its dictionary was
+  // abandoned, in which case PLAIN.
+  Encoding::type DataPageEncoding() const;
+
+  // Calls callback with each PLAIN encoded BYTE_ARRAY value, without
+  // its length prefix, in the data buffer pieces iovecs.
+  template <typename Callback>
+  static void ForEachByteArray(const vector<struct iovec>& iovecs,
+                               const Callback& callback);
+
+  // Encodes the values of page, which aren't PLAIN or dictionary
+  // encoded, into output.
+  void EncodeValues(const DataPageRange& page, vector<uint8_t>* output) const;
+
+  // Min, max and null count of the values in one data page.
+  parquet::Statistics PageStatistics(const DataPageRange& page) const;
+
+  // Adds a data page to the page index of the column chunk being
+  // encoded.  page_offset is where the page starts in the chunk, and
+  // page_bytes its size including the header.
+  void AddToPageIndex(const DataPageRange& page, uint64_t page_offset,
+                      uint32_t page_bytes,
+                      const parquet::Statistics& statistics);
+
+  // Sets the column index's boundary order from its pages' mins and
+  // maxes.
+  void ComputeBoundaryOrder();
+
+  // Encodes the column chunk's dictionary page.  Arguments are as for
+  // EncodeDataPage.
+  void EncodeDictionaryPage(
+      apache::thrift::protocol::TCompactProtocol* protocol,
+      apache::thrift::transport::TMemoryBuffer* header_buffer);
 
   // The name of the column as a vector of strings from the root to
   // the current node.
@@ -169,12 +422,66 @@ class ParquetColumn {
   Type::type data_type_;
   // Compression codec for this column
   CompressionCodec::type compression_codec_;
+  // Codec-specific compression level for this column.
+  int compression_level_;
   // A list of columns that are children of this one.
   vector<ParquetColumn*> children_;
 
   // Bookkeeping
-  // How many did the page header + R&D levels + data take up?
+  // How many did the page headers + R&D levels + data take up?
   uint64_t uncompressed_bytes_;
+  // The same, after the levels & data were compressed.
+  uint64_t compressed_bytes_;
+  // Amount of data after which a new data page is started.
+  uint32_t data_page_size_;
+  // Number of data pages in the last encoded column chunk.
+  uint32_t num_data_pages_;
+
+  // A piece of the encoded column chunk.  Uncompressed page data is
+  // written straight from data_buffer_ rather than copied.
+  struct EncodedSegment {
+    bool from_data_buffer;
+    size_t offset;
+    size_t length;
+  };
+  // Page headers, encoded levels and compressed pages of the encoded
+  // column chunk.
+  vector<uint8_t> encoded_pages_;
+  // The encoded column chunk, in the order it's written to the file.
+  vector<EncodedSegment> encoded_segments_;
+  // Page headers are serialized into header_buffer_ through
+  // header_protocol_.  Both live as long as the column, so the
+  // buffer's memory is reused by every page of every chunk.
+  std::shared_ptr<apache::thrift::transport::TMemoryBuffer> header_buffer_;
+  std::shared_ptr<apache::thrift::protocol::TCompactProtocol> header_protocol_;
+
+  // Distinct values of the current column chunk, if it's being
+  // dictionary encoded.
+  DictionaryEncoder dictionary_;
+  // Dictionary index of each non-null value in the column.
+  vector<uint32_t> dictionary_indices_;
+  uint32_t dictionary_page_size_limit_;
+  // Set when the current column chunk's dictionary outgrew the limit.
+  bool dictionary_fallback_;
+  // Whether the last encoded column chunk has a dictionary page, and
+  // how many bytes the page takes up in the file.
+  bool chunk_dictionary_encoded_;
+  uint64_t dictionary_page_bytes_;
+
+  // Min, max and null count of the values added since the last
+  // Reset(), kept up to date as they're added.
+  ColumnStatistics statistics_;
+  // The statistics of the last encoded column chunk.
+  parquet::Statistics chunk_statistics_;
+  // Bloom filter of the values added since the last Reset(), if it's
+  // enabled, and the serialized header it's written with.
+  std::unique_ptr<BloomFilter> bloom_filter_;
+  vector<uint8_t> bloom_filter_header_;
+  // Page index of the last encoded column chunk.  Page offsets are
+  // relative to the start of the chunk until it's written.
+  vector<parquet::PageLocation> page_locations_;
+  parquet::ColumnIndex column_index_;
+  bool has_column_index_;
 
   // How many pieces of data are in this column.  For this field, repeated
   // data is not counted as one record.  So if you had an array field, and
@@ -184,29 +491,47 @@ class ParquetColumn {
   // The number of bytes each instance of the datatype stored in this
   // column takes.
   uint8_t bytes_per_datum_;
-  // Data buffer for fixed-width data.
-  boost::shared_array<uint8_t> data_buffer_;
+  // Data buffer for the column's values.  It grows a chunk at a time
+  // and never splits a record between chunks, so each record's data
+  // is contiguous.
+  ChunkedBuffer data_buffer_;
 
   friend class ParquetFileBasicRequiredTest;
-  // Store some metadata for each record in the column.
-  vector<RecordMetadata> record_metadata;
-  // Current data pointer.  It points inside data_buffer_ above, but,
-  // sadly, there doesn't seem to be a way to use pointers to the
-  // middle of an array and get shared_array semantics with the array.
-  // So we have to use a raw pointer.  However, our semantics are
-  // fairly easy to understand: delete the buffer or decrease the ref
-  // count of the buffer pointed to by data_buffer_ (above) when this
-  // class is deleted, in which case the data_ptr_ is useless anyway.
-  uint8_t* data_ptr_;
-  
-  // Repetition level array. Run-length encoded before being written.
-  vector<uint8_t> repetition_levels_;
+  // Per-record bookkeeping.  Rather than store a level range and data
+  // range per record, store only where each record ends, as 32-bit
+  // offsets from the start of the column chunk, and only when they
+  // can't be computed from the record's index.  The offsets are
+  // absolute rather than delta coded, so any record can be found in
+  // constant time; a chunk whose levels or data go past UINT32_MAX is
+  // a fatal error.
+  uint32_t num_records_;
+  // Level end of each record; only needed for repeated columns.
+  vector<uint32_t> record_level_ends_;
+  // Data end of each record, unless implicit_data_offsets_ is set.
+  vector<uint32_t> record_data_ends_;
+  // Set while every record so far is exactly one fixed-width value,
+  // so record i's data is at i * bytes_per_datum_.  The first record
+  // that isn't (a null, a list, a byte array) clears it.
+  bool implicit_data_offsets_;
+
+  // Where records go instead, if RouteRecordsTo was called.
+  vector<ParquetColumn*> shard_columns_;
+  RecordRouter record_router_;
+  uint64_t num_routed_records_;
+
+  // Repetition levels, kept as runs.  Only stored for columns that
+  // write them (see HasRepetitionLevels).
+  LevelRuns repetition_levels_;
   // Integer representing max repetition level in the schema tree.
   uint16_t max_repetition_level_;
   // Integer representing max definition level.
   uint16_t max_definition_level_;
-  // Definition level array.  Also RLE before being written.
-  vector<uint8_t> definition_levels_;
+  // Definition levels, kept as runs.  Only stored for columns that
+  // write them (see HasDefinitionLevels).
+  LevelRuns definition_levels_;
+  // Number of levels in the column, whether or not they're stored.
+  // There is one per value, including nulls.
+  size_t num_levels_;
   // The offset into the file where column data is written.
   off_t column_write_offset_;
 };
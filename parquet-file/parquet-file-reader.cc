@@ -0,0 +1,1066 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./parquet-file-reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <parquet-file/compression.h>
+#include <parquet-file/util/rle-encoding.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+using apache::thrift::TException;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using parquet::CompressionCodec;
+using parquet::Encoding;
+using parquet::FieldRepetitionType;
+using parquet::PageType;
+using parquet::Type;
+
+namespace parquet_file {
+
+namespace {
+
+const char* kMagicBytes = "PAR1";
+const size_t kMagicLength = 4;
+
+// Size of a decoded fixed width value, or 0 for BYTE_ARRAY.
+size_t ValueWidth(const SchemaElement& element) {
+  switch (element.type) {
+    case Type::BOOLEAN:
+      return 1;
+    case Type::INT32:
+    case Type::FLOAT:
+      return 4;
+    case Type::INT64:
+    case Type::DOUBLE:
+      return 8;
+    case Type::INT96:
+      return 12;
+    case Type::FIXED_LEN_BYTE_ARRAY:
+      return element.type_length;
+    default:
+      return 0;
+  }
+}
+
+// Compares two fixed width values of type T.  NaNs aren't ordered,
+// so they compare as nothing.
+template <typename T>
+bool CompareFixedWidth(const string& a, const string& b, int* comparison) {
+  if (a.size() != sizeof(T) || b.size() != sizeof(T)) {
+    return false;
+  }
+  T a_value, b_value;
+  memcpy(&a_value, a.data(), sizeof(T));
+  memcpy(&b_value, b.data(), sizeof(T));
+  if (a_value < b_value) {
+    *comparison = -1;
+  } else if (b_value < a_value) {
+    *comparison = 1;
+  } else if (a_value == b_value) {
+    *comparison = 0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parses a Thrift struct serialized with the compact protocol from
+// the length bytes at data.  Sets object_length to the number of bytes
+// it took up, if it's not null.
+template <typename T>
+bool DeserializeThrift(const uint8_t* data, size_t length, T* object,
+                       uint32_t* object_length) {
+  try {
+    std::shared_ptr<TMemoryBuffer> buffer(
+        new TMemoryBuffer(const_cast<uint8_t*>(data), length,
+                          TMemoryBuffer::OBSERVE));
+    TCompactProtocol protocol(buffer);
+    uint32_t read_length = object->read(&protocol);
+    if (object_length != nullptr) {
+      *object_length = read_length;
+    }
+  } catch (const TException& e) {
+    LOG(ERROR) << "Could not parse Thrift data: " << e.what();
+    return false;
+  }
+  return true;
+}
+
+// Reads a little endian uint32_t.
+uint32_t ReadUint32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// Reads an unsigned LEB128 varint at *data, which must end before
+// end, and advances *data past it.
+bool ReadUleb128(const uint8_t** data, const uint8_t* end, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *data < end; shift += 7) {
+    uint8_t byte = *(*data)++;
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadZigZagVarint(const uint8_t** data, const uint8_t* end,
+                      int64_t* value) {
+  uint64_t encoded;
+  if (!ReadUleb128(data, end, &encoded)) {
+    return false;
+  }
+  *value = static_cast<int64_t>((encoded >> 1) ^ -(encoded & 1));
+  return true;
+}
+
+// Returns the num_bits bit value, at most 64 bits, that starts
+// bit_offset bits into data, bit packed least significant bit first.
+uint64_t UnpackValue(const uint8_t* data, size_t bit_offset, int num_bits) {
+  if (num_bits == 0) {
+    return 0;
+  }
+  data += bit_offset / 8;
+  int shift = bit_offset % 8;
+  uint64_t value = data[0] >> shift;
+  for (int bits = 8 - shift, i = 1; bits < num_bits; bits += 8, ++i) {
+    value |= static_cast<uint64_t>(data[i]) << bits;
+  }
+  return num_bits == 64 ? value : value & ((1ULL << num_bits) - 1);
+}
+
+// Decodes DELTA_BINARY_PACKED integers from input, appending them to
+// values, and sets consumed to the number of bytes they took up.
+// Differences are added with wraparound, so the low 32 bits of the
+// values are right for INT32 columns too.
+bool DecodeDeltaBinaryPackedValues(const uint8_t* input, size_t input_length,
+                                   vector<uint64_t>* values,
+                                   size_t* consumed) {
+  const uint8_t* data = input;
+  const uint8_t* end = input + input_length;
+  uint64_t block_size, miniblocks_per_block, num_values;
+  int64_t first_value;
+  if (!ReadUleb128(&data, end, &block_size) ||
+      !ReadUleb128(&data, end, &miniblocks_per_block) ||
+      !ReadUleb128(&data, end, &num_values) ||
+      !ReadZigZagVarint(&data, end, &first_value)) {
+    LOG(ERROR) << "Truncated DELTA_BINARY_PACKED header";
+    return false;
+  }
+  if (block_size == 0 || block_size % 128 != 0 ||
+      miniblocks_per_block == 0 || block_size % miniblocks_per_block != 0 ||
+      (block_size / miniblocks_per_block) % 32 != 0) {
+    LOG(ERROR) << "Bad DELTA_BINARY_PACKED block of " << block_size
+               << " values in " << miniblocks_per_block << " miniblocks";
+    return false;
+  }
+  uint64_t miniblock_size = block_size / miniblocks_per_block;
+  uint64_t value = first_value;
+  if (num_values > 0) {
+    values->push_back(value);
+  }
+  uint64_t remaining = num_values > 0 ? num_values - 1 : 0;
+  while (remaining > 0) {
+    int64_t min_delta;
+    if (!ReadZigZagVarint(&data, end, &min_delta) ||
+        end - data < miniblocks_per_block) {
+      LOG(ERROR) << "Truncated DELTA_BINARY_PACKED block";
+      return false;
+    }
+    const uint8_t* bit_widths = data;
+    data += miniblocks_per_block;
+    // Miniblocks after the last value aren't written.
+    for (uint64_t m = 0; m < miniblocks_per_block && remaining > 0; ++m) {
+      int bit_width = bit_widths[m];
+      if (bit_width > 64 ||
+          end - data < miniblock_size * bit_width / 8) {
+        LOG(ERROR) << "Bad or truncated DELTA_BINARY_PACKED miniblock";
+        return false;
+      }
+      uint64_t n = std::min(miniblock_size, remaining);
+      for (uint64_t i = 0; i < n; ++i) {
+        value += min_delta + UnpackValue(data, i * bit_width, bit_width);
+        values->push_back(value);
+      }
+      remaining -= n;
+      data += miniblock_size * bit_width / 8;
+    }
+  }
+  *consumed = data - input;
+  return true;
+}
+
+// Decodes num_values DELTA_LENGTH_BYTE_ARRAY values from input,
+// appending each to values.
+bool DecodeDeltaLengthByteArrayValues(const uint8_t* input,
+                                      size_t input_length, size_t num_values,
+                                      vector<string>* values) {
+  vector<uint64_t> lengths;
+  size_t consumed;
+  if (!DecodeDeltaBinaryPackedValues(input, input_length, &lengths,
+                                     &consumed)) {
+    return false;
+  }
+  if (lengths.size() != num_values) {
+    LOG(ERROR) << "Expected " << num_values << " byte array lengths, not "
+               << lengths.size();
+    return false;
+  }
+  const char* bytes = reinterpret_cast<const char*>(input) + consumed;
+  size_t bytes_left = input_length - consumed;
+  for (uint64_t length : lengths) {
+    length = static_cast<uint32_t>(length);
+    if (length > bytes_left) {
+      LOG(ERROR) << "Byte array values run past the end of the page";
+      return false;
+    }
+    values->push_back(string(bytes, length));
+    bytes += length;
+    bytes_left -= length;
+  }
+  return true;
+}
+
+// Compares a and b, PLAIN encoded values of the column described by
+// element, in the column's sort order: signed for numbers unless
+// they're annotated as unsigned, and unsigned bytewise for byte
+// arrays.  Returns false if the column has no order we can compare
+// in, or the values are malformed.
+bool CompareValues(const SchemaElement& element, const string& a,
+                   const string& b, int* comparison) {
+  bool is_unsigned = element.__isset.converted_type &&
+      (element.converted_type == parquet::ConvertedType::UINT_8 ||
+       element.converted_type == parquet::ConvertedType::UINT_16 ||
+       element.converted_type == parquet::ConvertedType::UINT_32 ||
+       element.converted_type == parquet::ConvertedType::UINT_64);
+  switch (element.type) {
+    case Type::BOOLEAN:
+      return CompareFixedWidth<bool>(a, b, comparison);
+    case Type::INT32:
+      return is_unsigned ? CompareFixedWidth<uint32_t>(a, b, comparison) :
+          CompareFixedWidth<int32_t>(a, b, comparison);
+    case Type::INT64:
+      return is_unsigned ? CompareFixedWidth<uint64_t>(a, b, comparison) :
+          CompareFixedWidth<int64_t>(a, b, comparison);
+    case Type::FLOAT:
+      return CompareFixedWidth<float>(a, b, comparison);
+    case Type::DOUBLE:
+      return CompareFixedWidth<double>(a, b, comparison);
+    case Type::BYTE_ARRAY:
+    case Type::FIXED_LEN_BYTE_ARRAY: {
+      // Decimals are signed two's complement, which bytewise order
+      // gets wrong.
+      if (element.__isset.converted_type &&
+          element.converted_type == parquet::ConvertedType::DECIMAL) {
+        return false;
+      }
+      int result = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+      if (result == 0) {
+        result = a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+      }
+      *comparison = result;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+void ColumnChunkData::Clear() {
+  num_levels = 0;
+  repetition_levels.clear();
+  definition_levels.clear();
+  num_values = 0;
+  values.clear();
+  value_offsets.assign(1, 0);
+}
+
+ParquetFileReader::ParquetFileReader(const string& filename)
+  : data_(nullptr),
+    length_(0),
+    fd_(-1),
+    mapped_(false),
+    ok_(false),
+    bytes_read_(0) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ == -1) {
+    LOG(ERROR) << "Could not open " << filename << ": " << strerror(errno);
+    return;
+  }
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) == -1) {
+    LOG(ERROR) << "Could not stat " << filename << ": " << strerror(errno);
+    return;
+  }
+  length_ = file_stat.st_size;
+  if (length_ == 0) {
+    LOG(ERROR) << filename << " is empty";
+    return;
+  }
+  void* mapping = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (mapping == MAP_FAILED) {
+    LOG(ERROR) << "Could not map " << filename << ": " << strerror(errno);
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(mapping);
+  mapped_ = true;
+  // Scans jump between the chunks of the columns they project, so
+  // readahead would mostly pull in columns nobody asked for.
+  madvise(mapping, length_, MADV_RANDOM);
+  ok_ = ReadFooter();
+}
+
+ParquetFileReader::ParquetFileReader(const uint8_t* data, size_t length)
+  : data_(data),
+    length_(length),
+    fd_(-1),
+    mapped_(false),
+    ok_(false),
+    bytes_read_(0) {
+  ok_ = ReadFooter();
+}
+
+ParquetFileReader::~ParquetFileReader() {
+  if (mapped_) {
+    munmap(const_cast<uint8_t*>(data_), length_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool ParquetFileReader::ReadFooter() {
+  // The file starts with the magic bytes, and ends with the footer,
+  // its length and the magic bytes again.
+  if (length_ < 2 * kMagicLength + sizeof(uint32_t) ||
+      memcmp(data_, kMagicBytes, kMagicLength) != 0 ||
+      memcmp(data_ + length_ - kMagicLength, kMagicBytes, kMagicLength) != 0) {
+    LOG(ERROR) << "Not a Parquet file";
+    return false;
+  }
+  uint32_t footer_length =
+      ReadUint32(data_ + length_ - kMagicLength - sizeof(uint32_t));
+  if (footer_length > length_ - 2 * kMagicLength - sizeof(uint32_t)) {
+    LOG(ERROR) << "Footer length " << footer_length << " is past the start "
+               << "of the file";
+    return false;
+  }
+  const uint8_t* footer =
+      data_ + length_ - kMagicLength - sizeof(uint32_t) - footer_length;
+  if (!DeserializeThrift(footer, footer_length, &metadata_, nullptr)) {
+    LOG(ERROR) << "Could not parse the file metadata";
+    return false;
+  }
+  VLOG(2) << "Read metadata: " << metadata_.row_groups.size()
+          << " row groups, " << metadata_.num_rows << " rows";
+
+  if (metadata_.schema.empty()) {
+    LOG(ERROR) << "File has no schema";
+    return false;
+  }
+  // The first schema element is the root, which isn't part of any
+  // column's path.
+  size_t index = 1;
+  vector<string> path;
+  while (index < metadata_.schema.size()) {
+    if (!BuildLeafColumns(&index, &path, 0, 0)) {
+      return false;
+    }
+  }
+  for (const parquet::RowGroup& row_group : metadata_.row_groups) {
+    if (row_group.columns.size() != leaf_columns_.size()) {
+      LOG(ERROR) << "Row group has " << row_group.columns.size()
+                 << " column chunks for " << leaf_columns_.size()
+                 << " columns";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParquetFileReader::BuildLeafColumns(size_t* index, vector<string>* path,
+                                         uint16_t repetition_level,
+                                         uint16_t definition_level) {
+  if (*index >= metadata_.schema.size()) {
+    LOG(ERROR) << "Schema is missing elements";
+    return false;
+  }
+  const SchemaElement& element = metadata_.schema[(*index)++];
+  if (element.repetition_type != FieldRepetitionType::REQUIRED) {
+    ++definition_level;
+  }
+  if (element.repetition_type == FieldRepetitionType::REPEATED) {
+    ++repetition_level;
+  }
+  path->push_back(element.name);
+  if (element.num_children > 0) {
+    for (int i = 0; i < element.num_children; ++i) {
+      if (!BuildLeafColumns(index, path, repetition_level, definition_level)) {
+        return false;
+      }
+    }
+  } else {
+    LeafColumn column;
+    column.element = element;
+    column.path = path->front();
+    for (size_t i = 1; i < path->size(); ++i) {
+      column.path += "." + (*path)[i];
+    }
+    column.max_repetition_level = repetition_level;
+    column.max_definition_level = definition_level;
+    leaf_columns_.push_back(column);
+  }
+  path->pop_back();
+  return true;
+}
+
+const string& ParquetFileReader::ColumnPath(int column_index) const {
+  return leaf_columns_.at(column_index).path;
+}
+
+int ParquetFileReader::ColumnIndex(const string& path) const {
+  for (int i = 0; i < leaf_columns_.size(); ++i) {
+    if (leaf_columns_[i].path == path) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint16_t ParquetFileReader::MaxRepetitionLevel(int column_index) const {
+  return leaf_columns_.at(column_index).max_repetition_level;
+}
+
+uint16_t ParquetFileReader::MaxDefinitionLevel(int column_index) const {
+  return leaf_columns_.at(column_index).max_definition_level;
+}
+
+const ColumnMetaData& ParquetFileReader::ColumnChunkMetaData(
+    int row_group, int column_index) const {
+  return metadata_.row_groups.at(row_group).columns.at(column_index).meta_data;
+}
+
+bool ParquetFileReader::ReadColumnChunk(int row_group, int column_index,
+                                        ColumnChunkData* data) const {
+  CHECK_NOTNULL(data);
+  CHECK(ok_) << "Reader isn't open";
+  const LeafColumn& column = leaf_columns_.at(column_index);
+  const ColumnMetaData& metadata = ColumnChunkMetaData(row_group, column_index);
+  data->Clear();
+  data->type = column.element.type;
+
+  // The chunk starts with its dictionary page, if it has one.
+  int64_t chunk_start = metadata.data_page_offset;
+  if (metadata.__isset.dictionary_page_offset &&
+      metadata.dictionary_page_offset > 0) {
+    chunk_start = std::min(chunk_start, metadata.dictionary_page_offset);
+  }
+  int64_t chunk_end = chunk_start + metadata.total_compressed_size;
+  if (chunk_start < kMagicLength || metadata.total_compressed_size < 0 ||
+      chunk_end > length_ - kMagicLength) {
+    LOG(ERROR) << "Column chunk of " << column.path << " is outside the file";
+    return false;
+  }
+  VLOG(2) << "Reading column chunk of " << column.path << ": "
+          << metadata.total_compressed_size << " bytes at offset "
+          << chunk_start;
+  if (mapped_) {
+    // Fault in the whole chunk up front, since every byte of it is
+    // about to be read.
+    const int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t aligned_start = chunk_start - chunk_start % page_size;
+    madvise(const_cast<uint8_t*>(data_) + aligned_start,
+            chunk_end - aligned_start, MADV_WILLNEED);
+  }
+  bytes_read_ += metadata.total_compressed_size;
+
+  ColumnChunkData dictionary;
+  bool have_dictionary = false;
+  vector<uint8_t> decompressed;
+  int64_t offset = chunk_start;
+  while (offset < chunk_end && data->num_levels < metadata.num_values) {
+    PageHeader header;
+    uint32_t header_length;
+    if (!ReadPageHeader(data_ + offset, chunk_end - offset, &header,
+                        &header_length)) {
+      return false;
+    }
+    offset += header_length;
+    if (header.compressed_page_size < 0 ||
+        header.compressed_page_size > chunk_end - offset ||
+        header.uncompressed_page_size < 0) {
+      LOG(ERROR) << "Page of " << column.path << " runs past its chunk";
+      return false;
+    }
+    const uint8_t* page = data_ + offset;
+    size_t page_length = header.compressed_page_size;
+    offset += header.compressed_page_size;
+    if (metadata.codec != CompressionCodec::UNCOMPRESSED) {
+      if (!Decompress(metadata.codec, page, page_length,
+                      header.uncompressed_page_size, &decompressed)) {
+        LOG(ERROR) << "Could not decompress page of " << column.path;
+        return false;
+      }
+      page = decompressed.data();
+      page_length = decompressed.size();
+    }
+
+    switch (header.type) {
+      case PageType::DICTIONARY_PAGE:
+        dictionary.Clear();
+        dictionary.type = column.element.type;
+        if (!DecodePlainValues(column, page, page_length,
+                               header.dictionary_page_header.num_values,
+                               &dictionary)) {
+          return false;
+        }
+        have_dictionary = true;
+        break;
+      case PageType::DATA_PAGE:
+        if (!DecodeDataPage(column, header, page, page_length,
+                            have_dictionary ? &dictionary : nullptr, data)) {
+          return false;
+        }
+        break;
+      default:
+        LOG(ERROR) << "Unsupported page type: "
+                   << parquet::_PageType_VALUES_TO_NAMES.at(header.type);
+        return false;
+    }
+  }
+  if (data->num_levels != metadata.num_values) {
+    LOG(ERROR) << "Column chunk of " << column.path << " has "
+               << data->num_levels << " values, metadata says "
+               << metadata.num_values;
+    return false;
+  }
+  return true;
+}
+
+bool ParquetFileReader::RowGroupMightMatch(
+    int row_group, const vector<RangePredicate>& predicates) const {
+  for (const RangePredicate& predicate : predicates) {
+    int column_index = ColumnIndex(predicate.column_path);
+    LOG_IF(FATAL, column_index == -1) << "Predicate on unknown column "
+                                      << predicate.column_path;
+    const SchemaElement& element = leaf_columns_[column_index].element;
+    size_t width = ValueWidth(element);
+    LOG_IF(FATAL, element.type != Type::BYTE_ARRAY &&
+           ((predicate.has_min && predicate.min.size() != width) ||
+            (predicate.has_max && predicate.max.size() != width)))
+        << "Predicate on " << predicate.column_path
+        << " doesn't match the column's type";
+    if (!ChunkMightMatch(element,
+                         ColumnChunkMetaData(row_group, column_index),
+                         predicate)) {
+      VLOG(2) << "Skipping row group " << row_group << ": statistics of "
+              << predicate.column_path << " rule out the predicate";
+      return false;
+    }
+    if (predicate.has_min && predicate.has_max &&
+        predicate.min == predicate.max &&
+        !RowGroupMightContain(row_group, predicate.column_path,
+                              predicate.min)) {
+      VLOG(2) << "Skipping row group " << row_group << ": Bloom filter of "
+              << predicate.column_path << " rules out the predicate";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParquetFileReader::ChunkMightMatch(const SchemaElement& element,
+                                        const ColumnMetaData& metadata,
+                                        const RangePredicate& predicate) {
+  if (!metadata.__isset.statistics) {
+    return true;
+  }
+  const parquet::Statistics& statistics = metadata.statistics;
+  // Nulls never match, so a chunk of nulls can be skipped.
+  if (statistics.__isset.null_count &&
+      statistics.null_count >= metadata.num_values) {
+    return false;
+  }
+  const string* min;
+  const string* max;
+  if (statistics.__isset.min_value && statistics.__isset.max_value) {
+    min = &statistics.min_value;
+    max = &statistics.max_value;
+  } else if (statistics.__isset.min && statistics.__isset.max &&
+             element.type != Type::BYTE_ARRAY &&
+             element.type != Type::FIXED_LEN_BYTE_ARRAY) {
+    // The deprecated min and max of byte arrays were compared as
+    // signed bytes by some writers, so they're only trusted for
+    // numbers.
+    min = &statistics.min;
+    max = &statistics.max;
+  } else {
+    return true;
+  }
+  int comparison;
+  if (predicate.has_min) {
+    if (!CompareValues(element, *max, predicate.min, &comparison)) {
+      return true;
+    }
+    if (comparison < 0) {
+      return false;
+    }
+  }
+  if (predicate.has_max) {
+    if (!CompareValues(element, *min, predicate.max, &comparison)) {
+      return true;
+    }
+    if (comparison > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParquetFileReader::Scan(const vector<string>& column_paths,
+                             const vector<RangePredicate>& predicates,
+                             const RowGroupCallback& callback) const {
+  CHECK(ok_) << "Reader isn't open";
+  vector<int> column_indices;
+  for (const string& path : column_paths) {
+    int column_index = ColumnIndex(path);
+    if (column_index == -1) {
+      LOG(ERROR) << "No column " << path;
+      return false;
+    }
+    column_indices.push_back(column_index);
+  }
+  for (const RangePredicate& predicate : predicates) {
+    if (ColumnIndex(predicate.column_path) == -1) {
+      LOG(ERROR) << "No column " << predicate.column_path;
+      return false;
+    }
+  }
+  // The buffers are reused from one row group to the next.
+  vector<ColumnChunkData> columns(column_indices.size());
+  for (int row_group = 0; row_group < NumberOfRowGroups(); ++row_group) {
+    if (!RowGroupMightMatch(row_group, predicates)) {
+      continue;
+    }
+    for (size_t i = 0; i < column_indices.size(); ++i) {
+      if (!ReadColumnChunk(row_group, column_indices[i], &columns[i])) {
+        return false;
+      }
+    }
+    if (!callback(row_group, columns)) {
+      break;
+    }
+  }
+  return true;
+}
+
+bool ParquetFileReader::ReadPageHeader(const uint8_t* data, size_t length,
+                                       PageHeader* header,
+                                       uint32_t* header_length) const {
+  return DeserializeThrift(data, length, header, header_length);
+}
+
+bool ParquetFileReader::ReadColumnIndex(int row_group, int column_index,
+                                        parquet::ColumnIndex* index) const {
+  CHECK_NOTNULL(index);
+  const parquet::ColumnChunk& chunk =
+      metadata_.row_groups.at(row_group).columns.at(column_index);
+  if (!chunk.__isset.column_index_offset ||
+      chunk.column_index_offset < 0 || chunk.column_index_length < 0 ||
+      chunk.column_index_offset + chunk.column_index_length > length_) {
+    return false;
+  }
+  return DeserializeThrift(data_ + chunk.column_index_offset,
+                           chunk.column_index_length, index, nullptr);
+}
+
+bool ParquetFileReader::ReadOffsetIndex(int row_group, int column_index,
+                                        parquet::OffsetIndex* index) const {
+  CHECK_NOTNULL(index);
+  const parquet::ColumnChunk& chunk =
+      metadata_.row_groups.at(row_group).columns.at(column_index);
+  if (!chunk.__isset.offset_index_offset ||
+      chunk.offset_index_offset < 0 || chunk.offset_index_length < 0 ||
+      chunk.offset_index_offset + chunk.offset_index_length > length_) {
+    return false;
+  }
+  return DeserializeThrift(data_ + chunk.offset_index_offset,
+                           chunk.offset_index_length, index, nullptr);
+}
+
+bool ParquetFileReader::ReadBloomFilter(
+    int row_group, int column_index,
+    std::unique_ptr<BloomFilter>* filter) const {
+  CHECK_NOTNULL(filter);
+  const uint8_t* bitset;
+  uint32_t num_bytes;
+  if (!FindBloomFilter(row_group, column_index, &bitset, &num_bytes)) {
+    return false;
+  }
+  filter->reset(new BloomFilter(bitset, num_bytes));
+  return true;
+}
+
+bool ParquetFileReader::FindBloomFilter(int row_group, int column_index,
+                                        const uint8_t** bitset,
+                                        uint32_t* num_bytes) const {
+  const ColumnMetaData& metadata = ColumnChunkMetaData(row_group,
+                                                       column_index);
+  if (!metadata.__isset.bloom_filter_offset ||
+      metadata.bloom_filter_offset < 0 ||
+      metadata.bloom_filter_offset >= length_) {
+    return false;
+  }
+  const uint8_t* data = data_ + metadata.bloom_filter_offset;
+  size_t length = length_ - metadata.bloom_filter_offset;
+  parquet::BloomFilterHeader header;
+  uint32_t header_length;
+  if (!DeserializeThrift(data, length, &header, &header_length)) {
+    return false;
+  }
+  if (!header.algorithm.__isset.BLOCK || !header.hash.__isset.XXHASH ||
+      !header.compression.__isset.UNCOMPRESSED) {
+    LOG(ERROR) << "Unsupported Bloom filter for " << ColumnPath(column_index);
+    return false;
+  }
+  *num_bytes = header.numBytes;
+  if (!BloomFilter::IsValidNumBytes(*num_bytes) ||
+      *num_bytes > length - header_length) {
+    LOG(ERROR) << "Bloom filter of " << ColumnPath(column_index)
+               << " has a bad size: " << header.numBytes;
+    return false;
+  }
+  *bitset = data + header_length;
+  return true;
+}
+
+bool ParquetFileReader::RowGroupMightContain(int row_group,
+                                             const string& column_path,
+                                             const string& value) const {
+  int column_index = ColumnIndex(column_path);
+  LOG_IF(FATAL, column_index == -1) << "Bloom filter probe of unknown column "
+                                    << column_path;
+  // Probes the bitset where it is in the file; nothing is copied.
+  const uint8_t* bitset;
+  uint32_t num_bytes;
+  if (!FindBloomFilter(row_group, column_index, &bitset, &num_bytes)) {
+    return true;
+  }
+  return BloomFilterView(bitset, num_bytes).MightContain(BloomFilter::Hash(
+      reinterpret_cast<const uint8_t*>(value.data()), value.size()));
+}
+
+bool ParquetFileReader::DecodeDataPage(const LeafColumn& column,
+                                       const PageHeader& header,
+                                       const uint8_t* page, size_t page_length,
+                                       const ColumnChunkData* dictionary,
+                                       ColumnChunkData* data) const {
+  const parquet::DataPageHeader& page_header = header.data_page_header;
+  if (page_header.num_values < 0) {
+    LOG(ERROR) << "Negative number of values in page of " << column.path;
+    return false;
+  }
+  size_t num_levels = page_header.num_values;
+  size_t consumed;
+  if (column.max_repetition_level > 0) {
+    if (!DecodeLevels(page, page_length, column.max_repetition_level,
+                      num_levels, &data->repetition_levels, &consumed)) {
+      return false;
+    }
+    page += consumed;
+    page_length -= consumed;
+  }
+  size_t num_values = num_levels;
+  if (column.max_definition_level > 0) {
+    if (!DecodeLevels(page, page_length, column.max_definition_level,
+                      num_levels, &data->definition_levels, &consumed)) {
+      return false;
+    }
+    page += consumed;
+    page_length -= consumed;
+    num_values = std::count(data->definition_levels.end() - num_levels,
+                            data->definition_levels.end(),
+                            column.max_definition_level);
+  }
+  data->num_levels += num_levels;
+
+  switch (page_header.encoding) {
+    case Encoding::PLAIN:
+      return DecodePlainValues(column, page, page_length, num_values, data);
+    case Encoding::PLAIN_DICTIONARY:
+    case Encoding::RLE_DICTIONARY:
+      if (dictionary == nullptr) {
+        LOG(ERROR) << "Dictionary encoded page of " << column.path
+                   << " without a dictionary page";
+        return false;
+      }
+      return DecodeDictionaryIndices(column, page, page_length, num_values,
+                                     *dictionary, data);
+    case Encoding::DELTA_BINARY_PACKED:
+      return DecodeDeltaBinaryPacked(column, page, page_length, num_values,
+                                     data);
+    case Encoding::BYTE_STREAM_SPLIT:
+      return DecodeByteStreamSplit(column, page, page_length, num_values,
+                                   data);
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+    case Encoding::DELTA_BYTE_ARRAY:
+      return DecodeDeltaByteArrays(column, page_header.encoding, page,
+                                   page_length, num_values, data);
+    default:
+      LOG(ERROR) << "Unsupported encoding: "
+                 << parquet::_Encoding_VALUES_TO_NAMES.at(page_header.encoding);
+      return false;
+  }
+}
+
+bool ParquetFileReader::DecodeLevels(const uint8_t* page, size_t page_length,
+                                     uint16_t max_level, size_t num_levels,
+                                     vector<uint8_t>* levels,
+                                     size_t* consumed) const {
+  if (page_length < sizeof(uint32_t)) {
+    LOG(ERROR) << "Page too short for its levels";
+    return false;
+  }
+  uint32_t levels_length = ReadUint32(page);
+  if (levels_length > page_length - sizeof(uint32_t)) {
+    LOG(ERROR) << "Levels run past the end of the page";
+    return false;
+  }
+  impala::RleDecoder decoder(const_cast<uint8_t*>(page) + sizeof(uint32_t),
+                             levels_length,
+                             impala::RleEncoder::BitWidth(max_level));
+  for (size_t i = 0; i < num_levels; ++i) {
+    uint8_t level;
+    if (!decoder.Get(&level) || level > max_level) {
+      LOG(ERROR) << "Invalid or missing level " << i << " of " << num_levels;
+      return false;
+    }
+    levels->push_back(level);
+  }
+  *consumed = sizeof(uint32_t) + levels_length;
+  return true;
+}
+
+bool ParquetFileReader::DecodeDeltaBinaryPacked(const LeafColumn& column,
+                                                const uint8_t* input,
+                                                size_t input_length,
+                                                size_t num_values,
+                                                ColumnChunkData* data) const {
+  const SchemaElement& element = column.element;
+  if (element.type != Type::INT32 && element.type != Type::INT64) {
+    LOG(ERROR) << "DELTA_BINARY_PACKED values in non-integer column "
+               << column.path;
+    return false;
+  }
+  vector<uint64_t> values;
+  size_t consumed;
+  if (!DecodeDeltaBinaryPackedValues(input, input_length, &values,
+                                     &consumed)) {
+    return false;
+  }
+  if (values.size() != num_values) {
+    LOG(ERROR) << "Page of " << column.path << " has " << values.size()
+               << " DELTA_BINARY_PACKED values, not " << num_values;
+    return false;
+  }
+  // Values are stored little endian, so the low bytes are the INT32.
+  size_t width = ValueWidth(element);
+  size_t start = data->values.size();
+  data->values.resize(start + num_values * width);
+  for (size_t i = 0; i < num_values; ++i) {
+    memcpy(&data->values[start + i * width], &values[i], width);
+  }
+  data->num_values += num_values;
+  return true;
+}
+
+bool ParquetFileReader::DecodeDeltaByteArrays(const LeafColumn& column,
+                                              Encoding::type encoding,
+                                              const uint8_t* input,
+                                              size_t input_length,
+                                              size_t num_values,
+                                              ColumnChunkData* data) const {
+  if (column.element.type != Type::BYTE_ARRAY) {
+    LOG(ERROR) << parquet::_Encoding_VALUES_TO_NAMES.at(encoding)
+               << " values in non-BYTE_ARRAY column " << column.path;
+    return false;
+  }
+  // Front coded values start with the length of the prefix each one
+  // shares with the value before it.
+  vector<uint64_t> prefix_lengths;
+  if (encoding == Encoding::DELTA_BYTE_ARRAY) {
+    size_t consumed;
+    if (!DecodeDeltaBinaryPackedValues(input, input_length, &prefix_lengths,
+                                       &consumed)) {
+      return false;
+    }
+    if (prefix_lengths.size() != num_values) {
+      LOG(ERROR) << "Page of " << column.path << " has "
+                 << prefix_lengths.size() << " prefix lengths, not "
+                 << num_values;
+      return false;
+    }
+    input += consumed;
+    input_length -= consumed;
+  }
+  vector<string> values;
+  if (!DecodeDeltaLengthByteArrayValues(input, input_length, num_values,
+                                        &values)) {
+    LOG(ERROR) << "Bad byte array values in page of " << column.path;
+    return false;
+  }
+  string previous_value;
+  for (size_t i = 0; i < num_values; ++i) {
+    if (!prefix_lengths.empty()) {
+      uint32_t prefix_length = prefix_lengths[i];
+      if (prefix_length > previous_value.size()) {
+        LOG(ERROR) << "Prefix of value " << i << " in page of "
+                   << column.path << " is longer than the value before it";
+        return false;
+      }
+      values[i].insert(0, previous_value, 0, prefix_length);
+      previous_value = values[i];
+    }
+    data->values.insert(data->values.end(), values[i].begin(),
+                        values[i].end());
+    data->value_offsets.push_back(data->values.size());
+  }
+  data->num_values += num_values;
+  return true;
+}
+
+bool ParquetFileReader::DecodeByteStreamSplit(const LeafColumn& column,
+                                              const uint8_t* input,
+                                              size_t input_length,
+                                              size_t num_values,
+                                              ColumnChunkData* data) const {
+  const SchemaElement& element = column.element;
+  if (element.type != Type::FLOAT && element.type != Type::DOUBLE) {
+    LOG(ERROR) << "BYTE_STREAM_SPLIT values in column " << column.path
+               << ", which isn't FLOAT or DOUBLE";
+    return false;
+  }
+  size_t width = ValueWidth(element);
+  if (input_length < num_values * width) {
+    LOG(ERROR) << "Values of " << column.path
+               << " run past the end of the page";
+    return false;
+  }
+  // Byte b of value i is at b * num_values + i.
+  size_t start = data->values.size();
+  data->values.resize(start + num_values * width);
+  uint8_t* values = data->values.data() + start;
+  for (size_t b = 0; b < width; ++b) {
+    const uint8_t* stream = input + b * num_values;
+    for (size_t i = 0; i < num_values; ++i) {
+      values[i * width + b] = stream[i];
+    }
+  }
+  data->num_values += num_values;
+  return true;
+}
+
+bool ParquetFileReader::DecodePlainValues(const LeafColumn& column,
+                                          const uint8_t* input,
+                                          size_t input_length,
+                                          size_t num_values,
+                                          ColumnChunkData* data) const {
+  const SchemaElement& element = column.element;
+  if (element.type == Type::BYTE_ARRAY) {
+    // Each value is its length followed by its bytes.
+    const uint8_t* end = input + input_length;
+    for (size_t i = 0; i < num_values; ++i) {
+      if (end - input < sizeof(uint32_t)) {
+        LOG(ERROR) << "Byte array values of " << column.path
+                   << " run past the end of the page";
+        return false;
+      }
+      uint32_t length = ReadUint32(input);
+      input += sizeof(uint32_t);
+      if (end - input < length) {
+        LOG(ERROR) << "Byte array values of " << column.path
+                   << " run past the end of the page";
+        return false;
+      }
+      data->values.insert(data->values.end(), input, input + length);
+      data->value_offsets.push_back(data->values.size());
+      input += length;
+    }
+  } else if (element.type == Type::BOOLEAN) {
+    // Booleans are bit packed, least significant bit first.
+    if (input_length < (num_values + 7) / 8) {
+      LOG(ERROR) << "Boolean values of " << column.path
+                 << " run past the end of the page";
+      return false;
+    }
+    for (size_t i = 0; i < num_values; ++i) {
+      data->values.push_back((input[i / 8] >> (i % 8)) & 1);
+    }
+  } else {
+    size_t width = ValueWidth(element);
+    if (width == 0 || input_length < num_values * width) {
+      LOG(ERROR) << "Values of " << column.path
+                 << " run past the end of the page";
+      return false;
+    }
+    data->values.insert(data->values.end(), input, input + num_values * width);
+  }
+  data->num_values += num_values;
+  return true;
+}
+
+bool ParquetFileReader::DecodeDictionaryIndices(
+    const LeafColumn& column, const uint8_t* input, size_t input_length,
+    size_t num_values, const ColumnChunkData& dictionary,
+    ColumnChunkData* data) const {
+  if (num_values == 0) {
+    return true;
+  }
+  // The indices are the bit width, followed by the RLE/bit-packed
+  // hybrid encoding of the indices without a length.
+  if (input_length < 1 || input[0] > 32) {
+    LOG(ERROR) << "Invalid dictionary index bit width for " << column.path;
+    return false;
+  }
+  impala::RleDecoder decoder(const_cast<uint8_t*>(input) + 1,
+                             input_length - 1, input[0]);
+  size_t width = ValueWidth(column.element);
+  for (size_t i = 0; i < num_values; ++i) {
+    uint32_t index;
+    if (!decoder.Get(&index) || index >= dictionary.num_values) {
+      LOG(ERROR) << "Invalid or missing dictionary index for " << column.path;
+      return false;
+    }
+    if (column.element.type == Type::BYTE_ARRAY) {
+      const uint8_t* value =
+          dictionary.values.data() + dictionary.value_offsets[index];
+      data->values.insert(data->values.end(), value,
+                          value + dictionary.value_offsets[index + 1] -
+                          dictionary.value_offsets[index]);
+      data->value_offsets.push_back(data->values.size());
+    } else {
+      const uint8_t* value = dictionary.values.data() + index * width;
+      data->values.insert(data->values.end(), value, value + width);
+    }
+  }
+  data->num_values += num_values;
+  return true;
+}
+
+}  // namespace parquet_file
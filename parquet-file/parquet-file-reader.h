@@ -0,0 +1,277 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include "./parquet_types.h"
+#include <parquet-file/bloom-filter.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef PARQUET_FILE_PARQUET_FILE_READER_H_
+#define PARQUET_FILE_PARQUET_FILE_READER_H_
+
+using parquet::ColumnMetaData;
+using parquet::FileMetaData;
+using parquet::PageHeader;
+using parquet::SchemaElement;
+using std::function;
+using std::string;
+using std::vector;
+
+namespace parquet_file {
+
+// The decoded contents of one column chunk.
+struct ColumnChunkData {
+  parquet::Type::type type;
+  // Number of levels in the chunk, i.e. the number of values
+  // including nulls.
+  size_t num_levels;
+  // One level per value, or empty if the column has no repetition
+  // (respectively definition) levels.
+  vector<uint8_t> repetition_levels;
+  vector<uint8_t> definition_levels;
+  // Number of non-null values.
+  size_t num_values;
+  // The non-null values.  Fixed width values are packed back to back
+  // in their in-memory representation (BOOLEANs take a byte each).
+  // BYTE_ARRAY values are concatenated, with value i running from
+  // value_offsets[i] to value_offsets[i + 1].
+  vector<uint8_t> values;
+  vector<uint32_t> value_offsets;
+
+  // Returns the fixed width values as an array of T.
+  template <typename T>
+  const T* Values() const {
+    return reinterpret_cast<const T*>(values.data());
+  }
+
+  // Returns BYTE_ARRAY value i.
+  string ByteArrayValue(size_t i) const {
+    return string(reinterpret_cast<const char*>(values.data()) +
+                  value_offsets[i],
+                  value_offsets[i + 1] - value_offsets[i]);
+  }
+
+  // Discards the contents, keeping the buffers for reuse.
+  void Clear();
+};
+
+// A range of values of one column that a scan is interested in.
+// Bounds are inclusive and in the column's PLAIN encoding, like the
+// values in Statistics; a missing bound is unbounded.  Rows whose
+// value is null never match.
+struct RangePredicate {
+  string column_path;
+  bool has_min;
+  string min;
+  bool has_max;
+  string max;
+
+  template <typename T>
+  static RangePredicate Between(const string& column_path, T min, T max) {
+    return RangePredicate{column_path, true, Encode(min), true, Encode(max)};
+  }
+  template <typename T>
+  static RangePredicate AtLeast(const string& column_path, T min) {
+    return RangePredicate{column_path, true, Encode(min), false, ""};
+  }
+  template <typename T>
+  static RangePredicate AtMost(const string& column_path, T max) {
+    return RangePredicate{column_path, false, "", true, Encode(max)};
+  }
+
+ private:
+  template <typename T>
+  static string Encode(T value) {
+    string encoded(sizeof(value), '\0');
+    memcpy(&encoded[0], &value, sizeof(value));
+    return encoded;
+  }
+  static string Encode(const string& value) { return value; }
+  static string Encode(const char* value) { return value; }
+};
+
+// Reads Parquet files: the footer's metadata, and column chunks,
+// decoded into ColumnChunkData.  The file is mmapped, and metadata and
+// page headers are parsed with Thrift's compact protocol straight out
+// of the mapping.  Supports v1 data pages, the encodings and codecs
+// the writer supports.
+class ParquetFileReader {
+ public:
+  // Maps and reads the footer of filename.  Check IsOK() before using
+  // the reader.
+  explicit ParquetFileReader(const string& filename);
+  // Reads a file that's already in memory, e.g. from a MemorySink.
+  // data must outlive the reader.
+  ParquetFileReader(const uint8_t* data, size_t length);
+  ~ParquetFileReader();
+
+  // True if the file was opened and its footer parsed.
+  bool IsOK() const { return ok_; }
+
+  const FileMetaData& MetaData() const { return metadata_; }
+  int NumberOfRowGroups() const { return metadata_.row_groups.size(); }
+  uint64_t NumberOfRows() const { return metadata_.num_rows; }
+
+  // Number of data-containing (leaf) columns.
+  int NumberOfColumns() const { return leaf_columns_.size(); }
+  // '.'-joined path of leaf column column_index, as ParquetColumn's
+  // FullSchemaPath() gives it.
+  const string& ColumnPath(int column_index) const;
+  // Returns the index of the leaf column whose path is path, or -1.
+  int ColumnIndex(const string& path) const;
+  // Max levels of leaf column column_index, from the schema.
+  uint16_t MaxRepetitionLevel(int column_index) const;
+  uint16_t MaxDefinitionLevel(int column_index) const;
+
+  // Metadata of the chunk of column column_index in row group
+  // row_group.
+  const ColumnMetaData& ColumnChunkMetaData(int row_group,
+                                            int column_index) const;
+
+  // Decodes the chunk of column column_index in row group row_group
+  // into data.  Only the bytes of that chunk are touched.  Returns
+  // false, with data in an undefined state, if the chunk is
+  // malformed or uses something this reader doesn't support.
+  bool ReadColumnChunk(int row_group, int column_index,
+                       ColumnChunkData* data) const;
+
+  // Parse the page index of a column chunk, which says where each of
+  // its data pages is, the first row in each, and their statistics,
+  // so readers can pick out pages without reading the others.  Return
+  // false if the chunk has no such index or it's malformed.
+  bool ReadColumnIndex(int row_group, int column_index,
+                       parquet::ColumnIndex* index) const;
+  bool ReadOffsetIndex(int row_group, int column_index,
+                       parquet::OffsetIndex* index) const;
+
+  // Reads the Bloom filter of a column chunk into filter.  Returns
+  // false if the chunk has no filter, or one this reader can't use.
+  bool ReadBloomFilter(int row_group, int column_index,
+                       std::unique_ptr<BloomFilter>* filter) const;
+
+  // Returns false if the Bloom filter of column_path's chunk in
+  // row_group shows it doesn't hold value, given in its PLAIN encoding
+  // (without the length of byte arrays).  Chunks without a filter
+  // always might.
+  bool RowGroupMightContain(int row_group, const string& column_path,
+                            const string& value) const;
+
+  // Returns false if the statistics of row_group show that none of
+  // its rows can match all of predicates, or if a predicate that's a
+  // single value isn't in the column's Bloom filter.  Row groups
+  // without statistics or filters for a predicate's column always
+  // might match.
+  bool RowGroupMightMatch(int row_group,
+                          const vector<RangePredicate>& predicates) const;
+
+  // Returns false if a column chunk with metadata, of a column
+  // described by element, can't hold a value matching predicate.
+  static bool ChunkMightMatch(const SchemaElement& element,
+                              const ColumnMetaData& metadata,
+                              const RangePredicate& predicate);
+
+  typedef function<bool(int row_group,
+                        const vector<ColumnChunkData>& columns)>
+      RowGroupCallback;
+
+  // Reads the columns at column_paths, given as FullSchemaPath()s, of
+  // each row group that might match all of predicates, and passes
+  // them to callback in the order of column_paths.  Pruning is per row
+  // group, so callers still have to check predicates against the rows
+  // they're given.  Only the chunks of the projected columns are read.
+  // Stops early if callback returns false.  Returns false if a path
+  // isn't a column or a chunk can't be read.
+  bool Scan(const vector<string>& column_paths,
+            const vector<RangePredicate>& predicates,
+            const RowGroupCallback& callback) const;
+
+  // Number of bytes of column chunks read so far.
+  uint64_t BytesRead() const { return bytes_read_; }
+
+ private:
+  struct LeafColumn {
+    SchemaElement element;
+    string path;
+    uint16_t max_repetition_level;
+    uint16_t max_definition_level;
+  };
+
+  // Checks the magic bytes and parses the footer into metadata_.
+  bool ReadFooter();
+  // Fills leaf_columns_ from the schema in metadata_.  index is the
+  // schema element to start at, and is advanced past its subtree.
+  bool BuildLeafColumns(size_t* index, vector<string>* path,
+                        uint16_t repetition_level, uint16_t definition_level);
+
+  // Parses the page header at data, which has length bytes left in
+  // the chunk.  Sets header_length to the size of the header.
+  bool ReadPageHeader(const uint8_t* data, size_t length, PageHeader* header,
+                      uint32_t* header_length) const;
+  // Sets bitset and num_bytes to the Bloom filter of a column chunk,
+  // where it is in data_.  Returns false if the chunk has no filter,
+  // or one this reader can't use.
+  bool FindBloomFilter(int row_group, int column_index,
+                       const uint8_t** bitset, uint32_t* num_bytes) const;
+  // Decodes the levels and values of a v1 data page of the column
+  // into data, looking values up in dictionary if they're dictionary
+  // encoded.
+  bool DecodeDataPage(const LeafColumn& column, const PageHeader& header,
+                      const uint8_t* page, size_t page_length,
+                      const ColumnChunkData* dictionary,
+                      ColumnChunkData* data) const;
+  // Decodes num_levels levels at most max_level, prefixed by their
+  // length in bytes, from the start of page.  Sets consumed to the
+  // number of bytes used.
+  bool DecodeLevels(const uint8_t* page, size_t page_length,
+                    uint16_t max_level, size_t num_levels,
+                    vector<uint8_t>* levels, size_t* consumed) const;
+  // Appends num_values PLAIN encoded values of the column, from
+  // input, to data.
+  bool DecodePlainValues(const LeafColumn& column, const uint8_t* input,
+                         size_t input_length, size_t num_values,
+                         ColumnChunkData* data) const;
+  // Appends num_values DELTA_BINARY_PACKED integers of the column,
+  // from input, to data.
+  bool DecodeDeltaBinaryPacked(const LeafColumn& column, const uint8_t* input,
+                               size_t input_length, size_t num_values,
+                               ColumnChunkData* data) const;
+  // Appends num_values BYTE_STREAM_SPLIT floating point values of the
+  // column, from input, to data.
+  bool DecodeByteStreamSplit(const LeafColumn& column, const uint8_t* input,
+                             size_t input_length, size_t num_values,
+                             ColumnChunkData* data) const;
+  // Appends num_values DELTA_LENGTH_BYTE_ARRAY or DELTA_BYTE_ARRAY
+  // (as encoding says) values of the column, from input, to data.
+  bool DecodeDeltaByteArrays(const LeafColumn& column,
+                             parquet::Encoding::type encoding,
+                             const uint8_t* input, size_t input_length,
+                             size_t num_values, ColumnChunkData* data) const;
+  // Appends num_values values of dictionary, whose RLE encoded
+  // indices are at input, to data.
+  bool DecodeDictionaryIndices(const LeafColumn& column,
+                               const uint8_t* input, size_t input_length,
+                               size_t num_values,
+                               const ColumnChunkData& dictionary,
+                               ColumnChunkData* data) const;
+
+  const uint8_t* data_;
+  size_t length_;
+  // Set if we mapped data_ ourselves.
+  int fd_;
+  bool mapped_;
+
+  FileMetaData metadata_;
+  vector<LeafColumn> leaf_columns_;
+  bool ok_;
+  mutable std::atomic<uint64_t> bytes_read_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_PARQUET_FILE_READER_H_
@@ -3,17 +3,31 @@
 #include <parquet-file/parquet-file.h>
 
 #include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
 #include <glog/logging.h>
+#include <iterator>
+#include <limits>
 #include <gtest/gtest.h>
 #include <limits.h>
+#include <math.h>
+#include <parquet-file/async-writer.h>
+#include <parquet-file/level-runs.h>
 #include <parquet-file/parquet-column.h>
+#include <parquet-file/parquet-file-reader.h>
+#include <parquet-file/parquet-sink.h>
+#include <parquet-file/positioned-writer.h>
+#include <parquet-file/util/rle-encoding.h>
+#include <parquet-file/worker-pool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <strings.h>
+#include <thread>
 #include <unistd.h>
 
 using parquet_file::ParquetColumn;
 using parquet_file::ParquetFile;
-using parquet_file::RecordMetadata;
 
 namespace parquet_file {
 
@@ -36,6 +50,13 @@ class ParquetFileTest : public ::testing::Test {
 
   virtual void TearDown() {
     if (!parquet_dump_executable_path_.empty()) {
+      // Tests that write to sink_ rather than a file only touch the
+      // file system here, so the dump tool has something to read.
+      if (sink_.Tell() > 0) {
+        std::ofstream file(output_filename_, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(sink_.Contents().data()),
+                   sink_.Contents().size());
+      }
       const ::testing::TestInfo* const test_info =
           ::testing::UnitTest::GetInstance()->current_test_info();
       char golden_filename[1024];
@@ -68,6 +89,8 @@ class ParquetFileTest : public ::testing::Test {
     }
   }
   // Objects declared here can be used by all tests in the test case for Foo.
+  // Tests that don't need a real file write to sink_.
+  MemorySink sink_;
   string output_filename_;
   char template_[32];
   string parquet_dump_executable_path_;
@@ -79,10 +102,10 @@ class ParquetFileBasicRequiredTest :
  protected:
 
   // This class is a friend of ParquetColumn but the test cases (which
-  // are subclasses) are not. So they can call this method to get &
-  // examine the record metadata.
-  vector<RecordMetadata>& getColumnRecordMetadata(ParquetColumn* column) {
-    return column->record_metadata;
+  // are subclasses) are not. So they can call this method to check
+  // whether a column stores its records' data offsets.
+  bool hasImplicitDataOffsets(ParquetColumn* column) {
+    return column->implicit_data_offsets_;
   }
 
   uint8_t* SentinelValueForType() {
@@ -114,7 +137,7 @@ class ParquetFileBasicRequiredTest :
 
 // Tests that the output works with two columns of required integers.
 TEST_P(ParquetFileBasicRequiredTest, TwoRequiredColumns) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   parquet::Type::type column_type = GetParam();
   ParquetColumn* one_column =
@@ -142,6 +165,9 @@ TEST_P(ParquetFileBasicRequiredTest, TwoRequiredColumns) {
     one_column->AddRecords(data_value.get(), 0, 1);
     two_column->AddRecords(data_value.get(), 0, 1);
   }
+  // Required fixed-width records don't need any per-record offsets.
+  CHECK(hasImplicitDataOffsets(one_column));
+  CHECK(hasImplicitDataOffsets(two_column));
   output.Flush();
   uint64_t expected_bytes_for_each_record = 2 * ParquetColumn::BytesForDataType(GetParam());
   CheckRecordMetadata(output,
@@ -157,7 +183,7 @@ INSTANTIATE_TEST_CASE_P(ParquetFileBasicTest,
                                           parquet::Type::FLOAT));
 
 TEST_F(ParquetFileTest, OneRequiredVariableByteArrayColumn) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   parquet::Type::type column_type = parquet::Type::BYTE_ARRAY;
   ParquetColumn* one_column =
@@ -189,9 +215,71 @@ TEST_F(ParquetFileTest, OneRequiredVariableByteArrayColumn) {
                       expected_bytes_for_each_record);
 }
 
+// Tests that a low cardinality string column is written with a
+// dictionary page ahead of its data pages.
+TEST_F(ParquetFileTest, OneDictionaryEncodedByteArrayColumn) {
+  ParquetFile output(&sink_);
+  ParquetColumn* one_column =
+    new ParquetColumn({"ReferenceNames"}, parquet::Type::BYTE_ARRAY,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN_DICTIONARY,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  const char* reference_names[] = {"chr1", "chr2", "chrX"};
+  int num_values = 3000;
+  for (int i = 0; i < num_values; ++i) {
+    one_column->AddVariableLengthByteArray((void*)reference_names[i % 3], 0, 4);
+  }
+  CHECK(one_column->IsDictionaryEncoded());
+  output.Flush();
+  CheckRecordMetadata(output, num_values, {8});
+  ColumnMetaData column_metadata = one_column->ParquetColumnMetaData();
+  CHECK(column_metadata.__isset.dictionary_page_offset);
+  CHECK_GT(column_metadata.data_page_offset,
+           column_metadata.dictionary_page_offset);
+  CHECK_EQ(column_metadata.encodings[0], Encoding::PLAIN_DICTIONARY);
+  // Each value takes 2 bits as an index, versus 8 bytes PLAIN.
+  CHECK_LT(column_metadata.total_compressed_size, num_values);
+}
+
+// Tests that a column falls back to PLAIN encoding once its
+// dictionary outgrows the limit.
+TEST_F(ParquetFileTest, DictionaryFallsBackToPlain) {
+  ParquetFile output(&sink_);
+  ParquetColumn* one_column =
+    new ParquetColumn({"Ints"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::RLE_DICTIONARY,
+                      CompressionCodec::UNCOMPRESSED);
+  one_column->setDictionaryPageSizeLimit(400);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  uint32_t data[1000];
+  for (int i = 0; i < 1000; ++i) {
+    data[i] = i;
+  }
+  one_column->AddRecords(data, 0, 50);
+  CHECK(one_column->IsDictionaryEncoded());
+  one_column->AddRecords(data + 50, 0, 950);
+  CHECK(!one_column->IsDictionaryEncoded());
+  output.Flush();
+  CheckRecordMetadata(output, 1000, {4});
+  ColumnMetaData column_metadata = one_column->ParquetColumnMetaData();
+  CHECK(!column_metadata.__isset.dictionary_page_offset);
+  CHECK_EQ(column_metadata.encodings.size(), 1);
+  CHECK_EQ(column_metadata.encodings[0], Encoding::PLAIN);
+}
+
 // Tests that the output works with two columns of required integers.
 TEST_F(ParquetFileTest, TwoRequiredColumnsWithProvidedBuffer) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   parquet::Type::type column_type = parquet::Type::INT32;
   boost::shared_array<uint8_t> buffer1(new uint8_t[2000]);
@@ -241,6 +329,800 @@ TEST_F(ParquetFileTest, TwoRequiredColumnsWithProvidedBuffer) {
                       { expected_bytes_for_each_record });
 }
 
+// Tests that a column can hold more data than fits in a single chunk
+// of its data buffer, and that records stay intact across chunks.
+TEST_F(ParquetFileTest, OneRequiredColumnSpanningBufferChunks) {
+  ParquetFile output(&sink_);
+
+  ParquetColumn* one_column =
+    new ParquetColumn({"AllInts"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  uint32_t data[1000];
+  for (int i = 0; i < 1000; ++i) {
+    data[i] = i;
+  }
+
+  // 4 MB of data, well past the size of the first chunk.
+  int num_batches = 1000;
+  for (int i = 0; i < num_batches; ++i) {
+    one_column->AddRecords(data, 0, 1000);
+  }
+  output.Flush();
+  CheckRecordMetadata(output,
+                      num_batches * 1000,
+                      { ParquetColumn::BytesForDataType(parquet::Type::INT32) });
+}
+
+// Tests that column chunks are split into data pages on record
+// boundaries.
+TEST_F(ParquetFileTest, RepeatedColumnMultipleDataPages) {
+  ParquetFile output(&sink_);
+
+  ParquetColumn* repeated_column =
+    new ParquetColumn({"AllIntsRepeated"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REPEATED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  // Each record below is 12 bytes, so a page holds 9 records.
+  repeated_column->setDataPageSize(100);
+
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({repeated_column});
+  output.SetSchema(root_column);
+  uint32_t data[3] = { 1, 2, 3 };
+  int num_records = 100;
+  for (int i = 0; i < num_records; ++i) {
+    repeated_column->AddRepeatedData(data, 0, 3);
+  }
+  output.Flush();
+  CHECK_EQ(repeated_column->NumDataPages(), 12);
+  CheckRecordMetadata(output, num_records, { 12 });
+}
+
+class ParquetFileCompressionTest :
+      public ParquetFileTest,
+      public ::testing::WithParamInterface<CompressionCodec::type> {
+};
+
+// Tests that compressed columns record both their compressed and
+// uncompressed sizes.
+TEST_P(ParquetFileCompressionTest, OneRequiredColumnCompressed) {
+  ParquetFile output(&sink_);
+
+  ParquetColumn* one_column =
+    new ParquetColumn({"AllInts"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      GetParam());
+  one_column->setDataPageSize(1000);
+
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  uint32_t data[500];
+  for (int i = 0; i < 500; ++i) {
+    data[i] = i % 10;
+  }
+  one_column->AddRecords(data, 0, 500);
+  output.Flush();
+  ColumnMetaData column_metadata = one_column->ParquetColumnMetaData();
+  CHECK_EQ(column_metadata.codec, GetParam());
+  CHECK_LT(column_metadata.total_compressed_size,
+           column_metadata.total_uncompressed_size);
+  CheckRecordMetadata(output, 500, { 4 });
+}
+
+// Tests that a higher compression level is passed through to the
+// codec.
+TEST_P(ParquetFileCompressionTest, CompressionLevel) {
+  if (GetParam() == CompressionCodec::SNAPPY) {
+    // Snappy doesn't have levels.
+    return;
+  }
+  ParquetFile output(&sink_);
+
+  ParquetColumn* fast_column =
+    new ParquetColumn({"Fast"}, parquet::Type::INT64,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      GetParam());
+  fast_column->setCompressionLevel(1);
+  ParquetColumn* small_column =
+    new ParquetColumn({"Small"}, parquet::Type::INT64,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      GetParam());
+  small_column->setCompressionLevel(9);
+
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({fast_column, small_column});
+  output.SetSchema(root_column);
+  uint64_t data[5000];
+  for (int i = 0; i < 5000; ++i) {
+    data[i] = (i * 7919) % 1000;
+  }
+  fast_column->AddRecords(data, 0, 5000);
+  small_column->AddRecords(data, 0, 5000);
+  output.Flush();
+  CHECK_EQ(small_column->getCompressionLevel(), 9);
+  CHECK_LE(small_column->ParquetColumnMetaData().total_compressed_size,
+           fast_column->ParquetColumnMetaData().total_compressed_size);
+}
+
+// Tests that compressed pages read back to the values written.
+TEST_P(ParquetFileCompressionTest, ReadBackCompressedPages) {
+  ParquetFile output(&sink_);
+  ParquetColumn* one_column =
+    new ParquetColumn({"AllInts"}, parquet::Type::INT32,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      GetParam());
+  one_column->setDataPageSize(1000);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  uint32_t data[2000];
+  for (int i = 0; i < 2000; ++i) {
+    data[i] = i * 7;
+  }
+  one_column->AddRecords(data, 0, 2000);
+  output.Flush();
+  CHECK_GT(one_column->NumDataPages(), 1);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.NumberOfRowGroups(), 1);
+  CHECK_EQ(reader.NumberOfColumns(), 1);
+  CHECK_EQ(reader.ColumnIndex("AllInts"), 0);
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, 2000);
+  CHECK(chunk.definition_levels.empty());
+  for (int i = 0; i < 2000; ++i) {
+    CHECK_EQ(chunk.Values<uint32_t>()[i], data[i]);
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(ParquetFileCompressionTest,
+                        ParquetFileCompressionTest,
+                        ::testing::Values(CompressionCodec::SNAPPY,
+                                          CompressionCodec::GZIP,
+                                          CompressionCodec::ZSTD));
+
+// Writes a file with many compressed columns using the given number
+// of encoding threads, and returns its contents.
+string WriteManyColumnFile(const string& filename, int num_threads) {
+  ParquetFile output(filename);
+  output.SetNumEncodingThreads(num_threads);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  vector<ParquetColumn*> columns;
+  for (int i = 0; i < 16; ++i) {
+    ParquetColumn* column =
+      new ParquetColumn({"Ints" + to_string(i)}, parquet::Type::INT32,
+                        1, 1,
+                        FieldRepetitionType::REQUIRED,
+                        Encoding::PLAIN,
+                        CompressionCodec::ZSTD);
+    column->setDataPageSize(4000);
+    columns.push_back(column);
+  }
+  root_column->SetChildren(columns);
+  output.SetSchema(root_column);
+  uint32_t data[1000];
+  for (int c = 0; c < columns.size(); ++c) {
+    for (int i = 0; i < 1000; ++i) {
+      data[i] = i * c;
+    }
+    columns[c]->AddRecords(data, 0, 1000);
+  }
+  output.Flush();
+  std::ifstream file(filename);
+  return string(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+}
+
+// Tests that encoding and writing column chunks in parallel produces
+// exactly the same file as doing them one at a time.
+TEST_F(ParquetFileTest, ParallelEncodingMatchesSerial) {
+  string serial_filename = output_filename_ + "-serial";
+  string serial_contents = WriteManyColumnFile(serial_filename, 1);
+  string parallel_contents = WriteManyColumnFile(output_filename_, 8);
+  unlink(serial_filename.c_str());
+  CHECK_GT(serial_contents.size(), 0);
+  CHECK(serial_contents == parallel_contents) <<
+      "Parallel encoding changed the file contents";
+}
+
+// Tests that a worker pool can be reused for many batches of work,
+// each index running exactly once.
+TEST(WorkerPoolTest, ForEachRunsEveryIndexOnce) {
+  WorkerPool pool(4);
+  CHECK_EQ(pool.NumThreads(), 4);
+  for (size_t n : { 0, 1, 3, 100 }) {
+    for (int batch = 0; batch < 10; ++batch) {
+      vector<std::atomic<int>> calls(n);
+      pool.ForEach(n, [&calls] (size_t i) {
+          ++calls[i];
+        });
+      for (size_t i = 0; i < n; ++i) {
+        CHECK_EQ(calls[i], 1) << "index " << i << " of " << n;
+      }
+    }
+  }
+  std::atomic<int> tasks_run(0);
+  for (int i = 0; i < 50; ++i) {
+    pool.Post([&tasks_run] () { ++tasks_run; });
+  }
+  pool.Wait();
+  CHECK_EQ(tasks_run, 50);
+}
+
+// Writes a few records of an optional byte array column to output.
+void WriteByteArrayRecords(ParquetFile* output) {
+  ParquetColumn* column =
+    new ParquetColumn({"Strings"}, parquet::Type::BYTE_ARRAY,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({column});
+  output->SetSchema(root_column);
+  for (int i = 0; i < 100; ++i) {
+    string value = "value " + to_string(i);
+    if (i % 10 == 0) {
+      column->AddNulls(0, 0, 1);
+    } else {
+      column->AddVariableLengthByteArray(&value[0], 0, value.size());
+    }
+  }
+  output->Flush();
+}
+
+// Tests that writing to memory or through a callback produces the
+// same bytes as writing to a file.
+TEST_F(ParquetFileTest, SinksWriteSameBytes) {
+  ParquetFile file_output(output_filename_);
+  WriteByteArrayRecords(&file_output);
+  std::ifstream file(output_filename_);
+  string file_contents((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  unlink(output_filename_.c_str());
+
+  ParquetFile memory_output(&sink_);
+  WriteByteArrayRecords(&memory_output);
+  string memory_contents(sink_.Contents().begin(), sink_.Contents().end());
+
+  string callback_contents;
+  bool closed = false;
+  CallbackSink callback_sink(
+      [&callback_contents] (const uint8_t* data, size_t length) {
+        callback_contents.append(reinterpret_cast<const char*>(data), length);
+        return true;
+      },
+      [&closed] () {
+        closed = true;
+        return true;
+      });
+  ParquetFile callback_output(&callback_sink);
+  WriteByteArrayRecords(&callback_output);
+
+  CHECK_GT(file_contents.size(), 0);
+  CHECK(file_contents == memory_contents);
+  CHECK(file_contents == callback_contents);
+  CHECK_EQ(callback_sink.Tell(), callback_contents.size());
+  CHECK(closed) << "Flush should close the sink";
+  CHECK_EQ(memory_contents.substr(0, 4), "PAR1");
+  CHECK_EQ(memory_contents.substr(memory_contents.size() - 4), "PAR1");
+}
+
+// Tests that a file written through a descriptor that's already part
+// way into a file starts there, with offsets relative to that start.
+TEST_F(ParquetFileTest, FileSinkAtNonzeroOffset) {
+  const string prefix(100, 'x');
+  int fd = open(output_filename_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  CHECK_NE(fd, -1);
+  CHECK_EQ(write(fd, prefix.data(), prefix.size()), prefix.size());
+  FileSink file_sink(fd);
+  CHECK_EQ(file_sink.Tell(), 0);
+  ParquetFile file_output(&file_sink);
+  WriteByteArrayRecords(&file_output);
+  close(fd);
+  std::ifstream file(output_filename_);
+  string file_contents((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  unlink(output_filename_.c_str());
+
+  ParquetFile memory_output(&sink_);
+  WriteByteArrayRecords(&memory_output);
+  CHECK_EQ(file_sink.Tell(), sink_.Contents().size());
+  CHECK_EQ(file_contents.substr(0, prefix.size()), prefix);
+  string parquet_contents = file_contents.substr(prefix.size());
+  CHECK(parquet_contents ==
+        string(sink_.Contents().begin(), sink_.Contents().end()));
+  ParquetFileReader reader(
+      reinterpret_cast<const uint8_t*>(parquet_contents.data()),
+      parquet_contents.size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.ColumnChunkMetaData(0, 0).data_page_offset, 4);
+}
+
+// Tests that a file can be streamed through a pipe, which can't seek,
+// and comes out the same as one written to memory.
+TEST_F(ParquetFileTest, StreamToPipe) {
+  int pipe_fds[2];
+  CHECK_EQ(pipe(pipe_fds), 0);
+  string piped_contents;
+  std::thread reader([&piped_contents, &pipe_fds] () {
+      char buffer[4096];
+      ssize_t bytes_read;
+      while ((bytes_read = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+        piped_contents.append(buffer, bytes_read);
+      }
+    });
+  StreamSink stream_sink(pipe_fds[1]);
+  ParquetFile stream_output(&stream_sink);
+  WriteByteArrayRecords(&stream_output);
+  close(pipe_fds[1]);
+  reader.join();
+  close(pipe_fds[0]);
+
+  ParquetFile memory_output(&sink_);
+  WriteByteArrayRecords(&memory_output);
+  CHECK_EQ(stream_sink.Tell(), piped_contents.size());
+  CHECK(piped_contents ==
+        string(sink_.Contents().begin(), sink_.Contents().end()));
+}
+
+// Tests that a dictionary encoded optional column reads back with its
+// nulls in place.
+TEST_F(ParquetFileTest, ReadBackDictionaryEncodedOptionalColumn) {
+  ParquetFile output(&sink_);
+  ParquetColumn* column =
+    new ParquetColumn({"Names"}, parquet::Type::BYTE_ARRAY,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::PLAIN_DICTIONARY,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({column});
+  output.SetSchema(root_column);
+  const char* names[] = {"chr1", "chr2", "chrX"};
+  for (int i = 0; i < 300; ++i) {
+    if (i % 10 == 0) {
+      column->AddNulls(0, 0, 1);
+    } else {
+      column->AddVariableLengthByteArray((void*)names[i % 3], 0, 4);
+    }
+  }
+  CHECK(column->IsDictionaryEncoded());
+  output.Flush();
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.MaxDefinitionLevel(0), 1);
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_levels, 300);
+  CHECK_EQ(chunk.num_values, 270);
+  size_t value = 0;
+  for (int i = 0; i < 300; ++i) {
+    CHECK_EQ(chunk.definition_levels[i], i % 10 == 0 ? 0 : 1);
+    if (i % 10 != 0) {
+      CHECK_EQ(chunk.ByteArrayValue(value++), names[i % 3]);
+    }
+  }
+}
+
+// Tests that repetition levels of a repeated column spanning several
+// pages read back.
+TEST_F(ParquetFileTest, ReadBackRepeatedColumn) {
+  ParquetFile output(&sink_);
+  ParquetColumn* repeated_column =
+    new ParquetColumn({"AllIntsRepeated"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REPEATED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  repeated_column->setDataPageSize(100);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({repeated_column});
+  output.SetSchema(root_column);
+  uint32_t data[3] = { 1, 2, 3 };
+  for (int i = 0; i < 100; ++i) {
+    repeated_column->AddRepeatedData(data, 0, 3);
+  }
+  output.Flush();
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.NumberOfRows(), 100);
+  CHECK_EQ(reader.MaxRepetitionLevel(0), 1);
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, 300);
+  for (int i = 0; i < 300; ++i) {
+    CHECK_EQ(chunk.repetition_levels[i], i % 3 == 0 ? 0 : 1);
+    CHECK_EQ(chunk.Values<uint32_t>()[i], data[i % 3]);
+  }
+}
+
+// Tests that DELTA_BINARY_PACKED integer columns, with nulls and
+// differences of any size, read back, and that near-monotonic values
+// take a fraction of their PLAIN size.
+TEST_F(ParquetFileTest, ReadBackDeltaBinaryPackedColumns) {
+  ParquetFile output(&sink_);
+  ParquetColumn* positions =
+    new ParquetColumn({"Positions"}, parquet::Type::INT64,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::DELTA_BINARY_PACKED,
+                      CompressionCodec::UNCOMPRESSED);
+  positions->setDataPageSize(4000);
+  ParquetColumn* qualities =
+    new ParquetColumn({"Qualities"}, parquet::Type::INT32,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::DELTA_BINARY_PACKED,
+                      CompressionCodec::SNAPPY);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({positions, qualities});
+  output.SetSchema(root_column);
+  for (int64_t i = 0; i < 2000; ++i) {
+    int64_t position = 1000000 + i * 3 + i % 4;
+    positions->AddRecords(&position, 0, 1);
+    if (i % 5 == 0) {
+      qualities->AddNulls(0, 0, 1);
+    } else {
+      int32_t quality = i % 2 ? INT32_MAX - i : INT32_MIN + i;
+      qualities->AddRecords(&quality, 0, 1);
+    }
+  }
+  output.Flush();
+  CHECK_GT(positions->NumDataPages(), 1);
+  CHECK_LT(positions->ParquetColumnMetaData().total_uncompressed_size,
+           2000 * sizeof(int64_t) / 8);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.ColumnChunkMetaData(0, 0).encodings[0],
+           Encoding::DELTA_BINARY_PACKED);
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, 2000);
+  for (int64_t i = 0; i < 2000; ++i) {
+    CHECK_EQ(chunk.Values<int64_t>()[i], 1000000 + i * 3 + i % 4);
+  }
+  CHECK(reader.ReadColumnChunk(0, 1, &chunk));
+  CHECK_EQ(chunk.num_values, 1600);
+  size_t value = 0;
+  for (int i = 0; i < 2000; ++i) {
+    CHECK_EQ(chunk.definition_levels[i], i % 5 == 0 ? 0 : 1);
+    if (i % 5 != 0) {
+      CHECK_EQ(chunk.Values<int32_t>()[value++],
+               i % 2 ? INT32_MAX - i : INT32_MIN + i);
+    }
+  }
+}
+
+class ParquetFileByteArrayEncodingTest :
+      public ParquetFileTest,
+      public ::testing::WithParamInterface<Encoding::type> {
+};
+
+// Tests that an optional byte array column of read names, written
+// with a delta encoding over several pages, reads back, and is smaller
+// than PLAIN.
+TEST_P(ParquetFileByteArrayEncodingTest, ReadBackDeltaByteArrays) {
+  ParquetFile output(&sink_);
+  ParquetColumn* names =
+    new ParquetColumn({"ReadNames"}, parquet::Type::BYTE_ARRAY,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      GetParam(),
+                      CompressionCodec::UNCOMPRESSED);
+  names->setDataPageSize(10000);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({names});
+  output.SetSchema(root_column);
+  vector<string> read_names;
+  uint64_t plain_bytes = 0;
+  for (int i = 0; i < 2000; ++i) {
+    if (i % 10 == 9) {
+      names->AddNulls(0, 0, 1);
+      continue;
+    }
+    read_names.push_back("HWI-ST1234:1:1101:" + to_string(10000 + i * 7) +
+                         ":" + to_string(i % 13));
+    names->AddVariableLengthByteArray(&read_names.back()[0], 0,
+                                      read_names.back().size());
+    plain_bytes += 4 + read_names.back().size();
+  }
+  output.Flush();
+  CHECK_GT(names->NumDataPages(), 1);
+  CHECK_LT(names->ParquetColumnMetaData().total_uncompressed_size,
+           plain_bytes);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.ColumnChunkMetaData(0, 0).encodings[0], GetParam());
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, read_names.size());
+  for (size_t i = 0; i < read_names.size(); ++i) {
+    CHECK_EQ(chunk.ByteArrayValue(i), read_names[i]);
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(ParquetFileByteArrayEncodingTest,
+                        ParquetFileByteArrayEncodingTest,
+                        ::testing::Values(Encoding::DELTA_LENGTH_BYTE_ARRAY,
+                                          Encoding::DELTA_BYTE_ARRAY));
+
+// Tests that BYTE_STREAM_SPLIT floating point columns read back, and
+// that the same doubles compress smaller split than PLAIN.
+TEST_F(ParquetFileTest, ReadBackByteStreamSplitColumns) {
+  ParquetFile output(&sink_);
+  ParquetColumn* split_scores =
+    new ParquetColumn({"SplitScores"}, parquet::Type::DOUBLE,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::BYTE_STREAM_SPLIT,
+                      CompressionCodec::ZSTD);
+  ParquetColumn* plain_scores =
+    new ParquetColumn({"PlainScores"}, parquet::Type::DOUBLE,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::ZSTD);
+  ParquetColumn* qualities =
+    new ParquetColumn({"Qualities"}, parquet::Type::FLOAT,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::BYTE_STREAM_SPLIT,
+                      CompressionCodec::UNCOMPRESSED);
+  qualities->setDataPageSize(1000);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({split_scores, plain_scores, qualities});
+  output.SetSchema(root_column);
+  for (int i = 0; i < 5000; ++i) {
+    double score = 30.0 + sin(i) * 10.0;
+    split_scores->AddRecords(&score, 0, 1);
+    plain_scores->AddRecords(&score, 0, 1);
+    if (i % 7 == 0) {
+      qualities->AddNulls(0, 0, 1);
+    } else {
+      float quality = i * 0.25f;
+      qualities->AddRecords(&quality, 0, 1);
+    }
+  }
+  output.Flush();
+  CHECK_LT(split_scores->ParquetColumnMetaData().total_compressed_size,
+           plain_scores->ParquetColumnMetaData().total_compressed_size);
+  CHECK_GT(qualities->NumDataPages(), 1);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.ColumnChunkMetaData(0, 0).encodings[0],
+           Encoding::BYTE_STREAM_SPLIT);
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, 5000);
+  for (int i = 0; i < 5000; ++i) {
+    CHECK_EQ(chunk.Values<double>()[i], 30.0 + sin(i) * 10.0);
+  }
+  CHECK(reader.ReadColumnChunk(0, 2, &chunk));
+  size_t value = 0;
+  for (int i = 0; i < 5000; ++i) {
+    if (i % 7 != 0) {
+      CHECK_EQ(chunk.Values<float>()[value++], i * 0.25f);
+    }
+  }
+  CHECK_EQ(value, chunk.num_values);
+}
+
+// Tests that the reader maps a file from disk, and rejects one
+// without a valid footer.
+TEST_F(ParquetFileTest, ReaderRejectsTruncatedFile) {
+  ParquetFile output(&sink_);
+  WriteByteArrayRecords(&output);
+  ParquetFileReader truncated(sink_.Contents().data(),
+                              sink_.Contents().size() - 1);
+  CHECK(!truncated.IsOK());
+  std::ofstream file(output_filename_, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(sink_.Contents().data()),
+             sink_.Contents().size());
+  file.close();
+  ParquetFileReader reader(output_filename_);
+  unlink(output_filename_.c_str());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.ColumnPath(0), "Strings");
+  ColumnChunkData chunk;
+  CHECK(reader.ReadColumnChunk(0, 0, &chunk));
+  CHECK_EQ(chunk.num_values, 90);
+  CHECK_EQ(chunk.ByteArrayValue(0), "value 1");
+}
+
+// Tests that records are spread evenly over the files when sharding
+// round-robin, and that every file is written.
+TEST_F(ParquetFileTest, ShardedRoundRobin) {
+  const int kNumFiles = 4;
+  ParquetFile output(output_filename_, kNumFiles);
+  output.SetRowGroupSizeInBytes(1000);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  ParquetColumn* one_column =
+    new ParquetColumn({"Ints"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  root_column->SetChildren({one_column});
+  output.SetSchema(root_column);
+  uint32_t data[100];
+  for (int i = 0; i < 100; ++i) {
+    data[i] = i;
+  }
+  for (int i = 0; i < 10; ++i) {
+    one_column->AddRecords(data, 0, 100);
+    output.MaybeFlushRowGroup();
+  }
+  output.Flush();
+  CHECK_EQ(output.NumberOfFiles(), kNumFiles);
+  for (int i = 0; i < kNumFiles; ++i) {
+    string filename =
+        ParquetFile::ShardFileName(output_filename_, i, kNumFiles);
+    CHECK_EQ(access(filename.c_str(), F_OK), 0) << "Missing " << filename;
+    CHECK_EQ(output.NumberOfRecordsWrittenToFile(i), 250);
+    unlink(filename.c_str());
+  }
+  CHECK_GE(output.NumberOfRowGroupsWritten(), kNumFiles);
+}
+
+// Tests that sharding by a key column keeps every record in the
+// file its key hashes to.
+TEST_F(ParquetFileTest, ShardedByKeyColumn) {
+  const int kNumFiles = 3;
+  ParquetFile output(output_filename_, kNumFiles);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  ParquetColumn* key_column =
+    new ParquetColumn({"Key"}, parquet::Type::INT64,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* value_column =
+    new ParquetColumn({"Values"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REPEATED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  root_column->SetChildren({key_column, value_column});
+  output.SetSchema(root_column);
+  output.SetShardingPolicy(parquet_file::HASH_KEY_COLUMN, "Key");
+  uint32_t values[3] = {1, 2, 3};
+  // Every record has the same key, so they all land in one file.
+  uint64_t key = 12345;
+  for (int i = 0; i < 300; ++i) {
+    key_column->AddRecords(&key, 0, 1);
+    value_column->AddRepeatedData(values, 0, 3);
+  }
+  output.Flush();
+  int files_with_records = 0;
+  for (int i = 0; i < kNumFiles; ++i) {
+    uint64_t records = output.NumberOfRecordsWrittenToFile(i);
+    if (records > 0) {
+      CHECK_EQ(records, 300);
+      ++files_with_records;
+    }
+    unlink(ParquetFile::ShardFileName(output_filename_, i, kNumFiles).c_str());
+  }
+  CHECK_EQ(files_with_records, 1);
+}
+
+// Tests that sharded records go straight to the files' columns as
+// they're added, rather than being buffered here too, and that each
+// file gets its records, in order, across several row groups.
+TEST_F(ParquetFileTest, ShardedRecordsGoStraightToFiles) {
+  const int kNumFiles = 2;
+  const int kNumRecords = 1000;
+  ParquetFile output(output_filename_, kNumFiles);
+  output.SetRowGroupSizeInBytes(800);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  ParquetColumn* ints =
+    new ParquetColumn({"Ints"}, parquet::Type::INT32,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* strings =
+    new ParquetColumn({"Strings"}, parquet::Type::BYTE_ARRAY,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  root_column->SetChildren({ints, strings});
+  output.SetSchema(root_column);
+  int32_t data[50];
+  for (int r = 0; r < kNumRecords; r += 50) {
+    for (int i = 0; i < 50; ++i) {
+      data[i] = r + i;
+    }
+    ints->AddRecords(data, 0, 50);
+    for (int i = r; i < r + 50; ++i) {
+      string value = "value " + to_string(i);
+      if (i % 10 == 0) {
+        strings->AddNulls(0, 0, 1);
+      } else {
+        strings->AddVariableLengthByteArray(&value[0], 0, value.size());
+      }
+    }
+    output.MaybeFlushRowGroup();
+    CHECK_EQ(ints->NumRecords(), 0);
+    CHECK_EQ(strings->NumRecords(), 0);
+    CHECK_EQ(ints->NumRoutedRecords(), r + 50);
+  }
+  output.Flush();
+
+  for (int f = 0; f < kNumFiles; ++f) {
+    string filename =
+        ParquetFile::ShardFileName(output_filename_, f, kNumFiles);
+    CHECK_EQ(output.NumberOfRecordsWrittenToFile(f), kNumRecords / kNumFiles);
+    ParquetFileReader reader(filename);
+    unlink(filename.c_str());
+    CHECK(reader.IsOK());
+    CHECK_GT(reader.NumberOfRowGroups(), 1);
+    // Round robin: file f has records f, f + 2, f + 4 and so on.
+    int next_record = f;
+    for (int g = 0; g < reader.NumberOfRowGroups(); ++g) {
+      ColumnChunkData int_chunk;
+      ColumnChunkData string_chunk;
+      CHECK(reader.ReadColumnChunk(g, 0, &int_chunk));
+      CHECK(reader.ReadColumnChunk(g, 1, &string_chunk));
+      CHECK_EQ(int_chunk.num_levels, string_chunk.num_levels);
+      size_t string_value = 0;
+      for (size_t i = 0; i < int_chunk.num_values; ++i) {
+        CHECK_EQ(int_chunk.Values<int32_t>()[i], next_record);
+        if (next_record % 10 == 0) {
+          CHECK_EQ(string_chunk.definition_levels[i], 0);
+        } else {
+          CHECK_EQ(string_chunk.ByteArrayValue(string_value++),
+                   "value " + to_string(next_record));
+        }
+        next_record += kNumFiles;
+      }
+      CHECK_EQ(string_value, string_chunk.num_values);
+    }
+    CHECK_EQ(next_record, kNumRecords + f);
+  }
+}
+
 // Tests that the output works with one column of required integers
 // that end up being 2 gibibytes.
 // TEST_F(ParquetFileTest, OneRequiredColumnsTwoGibibytesOfData) {
@@ -304,11 +1186,219 @@ class RowGroupTest : public ParquetFileTest {
 //       << "Number of row groups was not as expected";
 // }
 
+// Tests that the number of row groups is calculated from the columns'
+// running sizes, including the estimated size of their levels.
+TEST_F(RowGroupTest, CalculateNumberOfRowGroups) {
+  ParquetFile output(&sink_);
+  output.SetRowGroupSizeInBytes(4000);
+
+  ParquetColumn* required_column =
+    new ParquetColumn({"AllInts"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* optional_column =
+    new ParquetColumn({"SomeInts"}, parquet::Type::INT32,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({required_column, optional_column});
+  output.SetSchema(root_column);
+  int32_t data_value = INT_MAX;
+  for (int i = 0; i < 1250; ++i) {
+    required_column->AddRecords(&data_value, 0, 1);
+    optional_column->AddRecords(&data_value, 0, 1);
+  }
+  // Each record is 8 bytes of data and one bit of definition level.
+  CHECK_EQ(required_column->CumulativeSizeInBytes(999), 4000);
+  CHECK_EQ(optional_column->CumulativeSizeInBytes(999), 4000 + 125);
+  // So the first row group ends at record 492, the second at 985.
+  CHECK_EQ(output.CalculateNumberOfRowGroups(), 2);
+  output.Flush();
+}
+
+// Tests that row groups are written as the buffered data crosses the
+// row group size, and that the columns are reset after each one.
+TEST_F(RowGroupTest, StreamingRowGroups) {
+  ParquetFile output(&sink_);
+  output.SetRowGroupSizeInBytes(4000);
+
+  ParquetColumn* one_column =
+    new ParquetColumn({"AllInts"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+
+  ParquetColumn* two_column =
+    new ParquetColumn({"AllInts1"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({one_column, two_column});
+  output.SetSchema(root_column);
+  int32_t data_value = INT_MAX;
+
+  // Each record is 8 bytes, so a row group holds 500 records.
+  int num_values = 1250;
+  for (int i = 0; i < num_values; ++i) {
+    one_column->AddRecords(&data_value, 0, 1);
+    // Only one column has the record at this point, so a row group
+    // can't end here.
+    CHECK(!output.MaybeFlushRowGroup());
+    two_column->AddRecords(&data_value, 0, 1);
+    output.MaybeFlushRowGroup();
+  }
+  CHECK_EQ(output.NumberOfRowGroupsWritten(), 2);
+  CHECK_EQ(output.NumberOfRecords(), 250);
+  output.Flush();
+  CHECK_EQ(output.NumberOfRowGroupsWritten(), 3);
+}
+
+// Writes a file of several row groups of one column, with or without
+// asynchronous output, and returns its contents.
+string WriteStreamedFile(const string& filename, bool async_output) {
+  ParquetFile output(filename);
+  output.SetRowGroupSizeInBytes(4000);
+  if (async_output) {
+    output.SetAsyncOutput(2, 2);
+  }
+  ParquetColumn* column =
+    new ParquetColumn({"Ints"}, parquet::Type::INT32,
+                      1, 1,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({column});
+  output.SetSchema(root_column);
+  for (int32_t i = 0; i < 10000; ++i) {
+    column->AddRecords(&i, 0, 1);
+    output.MaybeFlushRowGroup();
+  }
+  output.Flush();
+  CHECK_GT(output.NumberOfRowGroupsWritten(), 2);
+  std::ifstream file(filename);
+  return string(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+}
+
+// Tests that queueing row groups to be written asynchronously,
+// while the next ones are buffered, produces the same file as writing
+// them synchronously.
+TEST_F(RowGroupTest, AsyncOutputMatchesSync) {
+  string sync_filename = output_filename_ + "-sync";
+  string sync_contents = WriteStreamedFile(sync_filename, false);
+  string async_contents = WriteStreamedFile(output_filename_, true);
+  unlink(sync_filename.c_str());
+  CHECK_GT(sync_contents.size(), 0);
+  CHECK(sync_contents == async_contents) <<
+      "Asynchronous output changed the file contents";
+}
+
+// Tests that an AsyncWriter writes everything it's queued where it was
+// reserved, and that it uses io_uring exactly when built with it.
+TEST(AsyncWriterTest, WritesLandWhereReserved) {
+  char filename[] = "/tmp/parquetFileTmp.XXXXXX";
+  int fd = mkstemp(filename);
+  CHECK_NE(fd, -1);
+  PositionedWriter writer(fd, 0);
+  vector<uint8_t> expected;
+  {
+    AsyncWriter async_writer(&writer, 2, 2);
+#ifdef HAVE_LIBURING
+    CHECK(async_writer.UsingIoUring())
+        << "Built with io_uring, but writes went through writer threads";
+#else
+    CHECK(!async_writer.UsingIoUring());
+#endif
+    for (int i = 0; i < 100; ++i) {
+      vector<uint8_t> data(1000 + i * 37, 'a' + i % 26);
+      vector<struct iovec> iovecs(2);
+      iovecs[0].iov_base = data.data();
+      iovecs[0].iov_len = 10;
+      iovecs[1].iov_base = data.data() + 10;
+      iovecs[1].iov_len = data.size() - 10;
+      async_writer.WriteAt(writer.Reserve(data.size()), iovecs);
+      expected.insert(expected.end(), data.begin(), data.end());
+    }
+    async_writer.WaitForCompletions();
+  }
+  CHECK_EQ(writer.Size(), expected.size());
+  vector<uint8_t> contents(expected.size());
+  CHECK_EQ(pread(fd, contents.data(), contents.size(), 0), contents.size());
+  close(fd);
+  unlink(filename);
+  CHECK(contents == expected) << "Asynchronous writes landed in the wrong place";
+}
+
+// Tests that a scan only reads the chunks of the columns it projects,
+// in every row group.
+TEST_F(RowGroupTest, ScanReadsOnlyProjectedColumns) {
+  ParquetFile output(&sink_);
+  output.SetRowGroupSizeInBytes(6000);
+  vector<ParquetColumn*> columns;
+  for (const char* name : {"A", "B", "C"}) {
+    columns.push_back(new ParquetColumn({name}, parquet::Type::INT32,
+                                        0, 0,
+                                        FieldRepetitionType::REQUIRED,
+                                        Encoding::PLAIN,
+                                        CompressionCodec::UNCOMPRESSED));
+  }
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren(columns);
+  output.SetSchema(root_column);
+  // Each record is 12 bytes, so a row group holds 500 records.
+  for (int32_t i = 0; i < 1500; ++i) {
+    for (int c = 0; c < columns.size(); ++c) {
+      int32_t value = i * 10 + c;
+      columns[c]->AddRecords(&value, 0, 1);
+    }
+    output.MaybeFlushRowGroup();
+  }
+  output.Flush();
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.NumberOfRowGroups(), 3);
+  uint64_t projected_bytes = 0;
+  for (int row_group = 0; row_group < 3; ++row_group) {
+    projected_bytes +=
+        reader.ColumnChunkMetaData(row_group, 1).total_compressed_size;
+  }
+  int32_t next_value = 1;
+  CHECK(reader.Scan({"B"}, {}, [&next_value] (
+      int row_group, const vector<ColumnChunkData>& chunks) {
+        CHECK_EQ(chunks.size(), 1);
+        for (size_t i = 0; i < chunks[0].num_values; ++i) {
+          CHECK_EQ(chunks[0].Values<int32_t>()[i], next_value);
+          next_value += 10;
+        }
+        return true;
+      }));
+  CHECK_EQ(next_value, 15001);
+  CHECK_EQ(reader.BytesRead(), projected_bytes);
+  CHECK(!reader.Scan({"D"}, {}, [] (
+      int row_group, const vector<ColumnChunkData>& chunks) {
+        return true;
+      }));
+}
+
 // Tests that the output works with two columns of integers, one array
 // and one non-array.  The array column has 1 array of 500 integers
 // the other column has 1 individual integer in the record.
 TEST_F(ParquetFileTest, TwoColumnsOfIntsOneRepeated) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -345,7 +1435,7 @@ TEST_F(ParquetFileTest, TwoColumnsOfIntsOneRepeated) {
 // Tests that the output works with one column of array integers.  The
 // test has 250 records of 2 element arrays.
 TEST_F(ParquetFileTest, OneColumn250Records) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -381,7 +1471,7 @@ TEST_F(ParquetFileTest, OneColumn250Records) {
 // 1 individual integer, for a total of 2 different records.  The
 // other column has 2 individual integers in the records.
 TEST_F(ParquetFileTest, TwoColumnOfIntsOneRepeatedAndNonRepeatedData) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -425,7 +1515,7 @@ TEST_F(ParquetFileTest, TwoColumnOfIntsOneRepeatedAndNonRepeatedData) {
 // Tests that the output works with optional data even if all data is
 // filled in.
 TEST_F(ParquetFileTest, OneColumnOptionalData) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -457,7 +1547,7 @@ TEST_F(ParquetFileTest, OneColumnOptionalData) {
 
 // Tests that the output works with optional data with nulls
 TEST_F(ParquetFileTest, OneColumn500Nulls) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -482,7 +1572,7 @@ TEST_F(ParquetFileTest, OneColumn500Nulls) {
 // Tests that the output works with optional data with interspersed
 // nulls & data.
 TEST_F(ParquetFileTest, OneColumn500NullsAndData) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -513,7 +1603,7 @@ TEST_F(ParquetFileTest, OneColumn500NullsAndData) {
 
 // Tests that the output works with nested fields.
 TEST_F(ParquetFileTest, OneColumnNestedData) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -557,7 +1647,7 @@ TEST_F(ParquetFileTest, OneColumnNestedData) {
 // Tests that the output works with nested optional fields at the
 // bottom of the schema tree (i.e. innermost field)
 TEST_F(ParquetFileTest, OneColumnNestedOptionalData) {
-  ParquetFile output(output_filename_);
+  ParquetFile output(&sink_);
 
   ParquetColumn* root_column =
     new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
@@ -599,6 +1689,589 @@ TEST_F(ParquetFileTest, OneColumnNestedOptionalData) {
                       expected_bytes_for_each_record);
 }
 
+// Tests that PutRun and PutBatch encode exactly what calling Put for
+// each value does.
+TEST(RleEncoderTest, PutRunAndPutBatchMatchPut) {
+  vector<uint8_t> levels;
+  for (int i = 0; i < 200; ++i) {
+    levels.insert(levels.end(), (i % 7) * (i % 5) + 1, i % 3);
+  }
+  int buffer_size = impala::RleEncoder::MaxBufferSize(levels.size() + 1000, 2);
+  vector<uint8_t> put_buffer(buffer_size), batch_buffer(buffer_size);
+  impala::RleEncoder put_encoder(put_buffer.data(), buffer_size, 2);
+  impala::RleEncoder batch_encoder(batch_buffer.data(), buffer_size, 2);
+  for (uint8_t level : levels) {
+    CHECK(put_encoder.Put(level));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(put_encoder.Put(1));
+  }
+  CHECK(batch_encoder.PutBatch(levels.data(), levels.size()));
+  CHECK(batch_encoder.PutRun(1, 1000));
+  int put_length = put_encoder.Flush();
+  int batch_length = batch_encoder.Flush();
+  CHECK_EQ(put_length, batch_length);
+  CHECK(std::equal(put_buffer.begin(), put_buffer.begin() + put_length,
+                   batch_buffer.begin()));
+}
+
+// Tests that levels appended as runs read back the same, and that
+// identical runs are merged.
+TEST(LevelRunsTest, AppendAndReadBack) {
+  LevelRuns levels;
+  levels.Append(0, 3);
+  levels.Append(0, 2);
+  levels.Append(1, 4);
+  levels.Append(0, 0);
+  levels.Append(2, 1);
+  CHECK_EQ(levels.size(), 10);
+  CHECK_EQ(levels.NumRuns(), 3);
+  CHECK_EQ(levels.at(4), 0);
+  CHECK_EQ(levels.at(5), 1);
+  CHECK_EQ(levels.at(9), 2);
+  CHECK_EQ(levels.Count(3, 6, 1), 4);
+}
+
+// Tests that levels that keep changing take up about a byte each,
+// while long runs take up next to nothing, and that both read back.
+TEST(LevelRunsTest, AlternatingLevelsTakeAboutAByteEach) {
+  LevelRuns alternating;
+  for (int i = 0; i < 100000; ++i) {
+    alternating.Append(i % 2, 1);
+  }
+  CHECK_EQ(alternating.size(), 100000);
+  CHECK_EQ(alternating.NumRuns(), 100000);
+  CHECK_LE(alternating.BytesUsed(), alternating.size() + 64);
+  CHECK_EQ(alternating.Count(0, alternating.size(), 1), 50000);
+
+  LevelRuns constant;
+  for (int i = 0; i < 100000; ++i) {
+    constant.Append(3, 1);
+  }
+  CHECK_EQ(constant.NumRuns(), 1);
+  CHECK_LT(constant.BytesUsed(), 64);
+
+  // Short and long runs mixed, appended in pieces.
+  srand(7);
+  LevelRuns mixed;
+  vector<uint8_t> expected;
+  for (int i = 0; i < 10000; ++i) {
+    uint8_t level = rand() % 3;
+    size_t count = rand() % 4 == 0 ? rand() % 40 : rand() % 4;
+    mixed.Append(level, count);
+    expected.insert(expected.end(), count, level);
+  }
+  CHECK_EQ(mixed.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    CHECK_EQ(mixed.at(i), expected[i]) << i;
+  }
+  size_t first = expected.size() / 3;
+  size_t num_levels = expected.size() / 2;
+  vector<uint8_t> expanded;
+  uint8_t last_level = 0;
+  mixed.ForEachRun(first, num_levels,
+                   [&expanded, &last_level] (uint8_t level, size_t count) {
+                     CHECK(expanded.empty() || level != last_level);
+                     CHECK_GT(count, 0);
+                     expanded.insert(expanded.end(), count, level);
+                     last_level = level;
+                   });
+  CHECK(expanded == vector<uint8_t>(expected.begin() + first,
+                                    expected.begin() + first + num_levels));
+  CHECK_EQ(mixed.Count(first, num_levels, 2),
+           std::count(expanded.begin(), expanded.end(), 2));
+}
+
+// Tests that scans skip the row groups whose statistics rule out
+// their predicates.
+TEST_F(RowGroupTest, ScanSkipsRowGroupsByStatistics) {
+  ParquetFile output(&sink_);
+  output.SetRowGroupSizeInBytes(4000);
+  ParquetColumn* column =
+    new ParquetColumn({"Ints"}, parquet::Type::INT32,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({column});
+  output.SetSchema(root_column);
+  // A row group holds 1000 records, so values 0-999 go in the first.
+  for (int32_t i = 0; i < 4500; ++i) {
+    column->AddRecords(&i, 0, 1);
+    output.MaybeFlushRowGroup();
+  }
+  output.Flush();
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK_EQ(reader.NumberOfRowGroups(), 5);
+  const parquet::Statistics& statistics =
+      reader.ColumnChunkMetaData(2, 0).statistics;
+  CHECK_EQ(*reinterpret_cast<const int32_t*>(statistics.min_value.data()),
+           2000);
+  CHECK_EQ(*reinterpret_cast<const int32_t*>(statistics.max_value.data()),
+           2999);
+  CHECK_EQ(statistics.null_count, 0);
+
+  vector<int> row_groups_read;
+  CHECK(reader.Scan({"Ints"}, {RangePredicate::Between("Ints", 2500, 3100)},
+                    [&row_groups_read] (
+                        int row_group, const vector<ColumnChunkData>& chunks) {
+                      row_groups_read.push_back(row_group);
+                      return true;
+                    }));
+  CHECK(row_groups_read == vector<int>({2, 3}));
+  CHECK_EQ(reader.BytesRead(),
+           reader.ColumnChunkMetaData(2, 0).total_compressed_size +
+           reader.ColumnChunkMetaData(3, 0).total_compressed_size);
+}
+
+// Tests that the page index written before the footer locates every
+// data page of a chunk, and describes sorted pages as ascending.
+TEST_F(ParquetFileTest, PageIndexLocatesPages) {
+  ParquetFile output(&sink_);
+  ParquetColumn* positions =
+    new ParquetColumn({"Positions"}, parquet::Type::INT64,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::SNAPPY);
+  // 100 records per page.
+  positions->setDataPageSize(800);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({positions});
+  output.SetSchema(root_column);
+  for (int64_t i = 0; i < 1000; ++i) {
+    int64_t position = i * 3;
+    positions->AddRecords(&position, 0, 1);
+  }
+  output.Flush();
+  CHECK_EQ(positions->NumDataPages(), 10);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  const ColumnMetaData& metadata = reader.ColumnChunkMetaData(0, 0);
+  parquet::OffsetIndex offset_index;
+  CHECK(reader.ReadOffsetIndex(0, 0, &offset_index));
+  CHECK_EQ(offset_index.page_locations.size(), 10);
+  int64_t page_offset = metadata.data_page_offset;
+  for (int i = 0; i < 10; ++i) {
+    const parquet::PageLocation& location = offset_index.page_locations[i];
+    CHECK_EQ(location.offset, page_offset);
+    CHECK_EQ(location.first_row_index, i * 100);
+    page_offset += location.compressed_page_size;
+  }
+  CHECK_EQ(page_offset,
+           metadata.data_page_offset + metadata.total_compressed_size);
+
+  parquet::ColumnIndex column_index;
+  CHECK(reader.ReadColumnIndex(0, 0, &column_index));
+  CHECK_EQ(column_index.boundary_order, parquet::BoundaryOrder::ASCENDING);
+  CHECK_EQ(column_index.min_values.size(), 10);
+  for (int i = 0; i < 10; ++i) {
+    CHECK(!column_index.null_pages[i]);
+    CHECK_EQ(column_index.null_counts[i], 0);
+    CHECK_EQ(*reinterpret_cast<const int64_t*>(
+        column_index.min_values[i].data()), i * 300);
+    CHECK_EQ(*reinterpret_cast<const int64_t*>(
+        column_index.max_values[i].data()), i * 300 + 297);
+  }
+}
+
+// Tests the statistics of a dictionary encoded byte array column with
+// nulls: nulls are counted, the dictionary gives the distinct count,
+// and a long max is truncated and rounded up.
+TEST_F(ParquetFileTest, ByteArrayStatistics) {
+  ParquetFile output(&sink_);
+  ParquetColumn* column =
+    new ParquetColumn({"Names"}, parquet::Type::BYTE_ARRAY,
+                      0, 1,
+                      FieldRepetitionType::OPTIONAL,
+                      Encoding::PLAIN_DICTIONARY,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({column});
+  output.SetSchema(root_column);
+  string long_name(100, 'z');
+  vector<string> names = {"chr2", "chr1", long_name, "chrX"};
+  for (int i = 0; i < 100; ++i) {
+    if (i % 4 == 3) {
+      column->AddNulls(0, 0, 1);
+    } else {
+      column->AddVariableLengthByteArray(&names[i % 4][0], 0,
+                                         names[i % 4].size());
+    }
+  }
+  output.Flush();
+  const parquet::Statistics statistics =
+      column->ParquetColumnMetaData().statistics;
+  CHECK_EQ(statistics.null_count, 25);
+  CHECK_EQ(statistics.distinct_count, 3);
+  CHECK_EQ(statistics.min_value, "chr1");
+  CHECK_EQ(statistics.max_value,
+           string(kMaxStatisticsValueLength - 1, 'z') + "{");
+  CHECK(!statistics.__isset.min);
+}
+
+// Returns the PLAIN encoded min or max value of a Statistics as a T.
+template <typename T>
+T DecodeStatistic(const string& encoded) {
+  CHECK_EQ(encoded.size(), sizeof(T));
+  T value;
+  memcpy(&value, encoded.data(), sizeof(T));
+  return value;
+}
+
+// Tests that the INT32 min/max kernel finds extremes in both its
+// vector loop and the scalar tail after it.
+TEST(ColumnStatisticsTest, Int32ExtremesInBodyAndTail) {
+  vector<int32_t> values;
+  for (int i = 0; i < 19; ++i) {
+    values.push_back(i - 9);
+  }
+  // The vector loop covers values 4 through 15; 16-18 are the tail.
+  values[5] = INT_MAX;
+  values[17] = INT_MIN;
+  ColumnStatistics statistics(parquet::Type::INT32);
+  statistics.AddValues(reinterpret_cast<uint8_t*>(values.data()),
+                       values.size());
+  parquet::Statistics thrift = statistics.ToThrift();
+  CHECK_EQ(DecodeStatistic<int32_t>(thrift.min_value), INT_MIN);
+  CHECK_EQ(DecodeStatistic<int32_t>(thrift.max_value), INT_MAX);
+
+  std::swap(values[5], values[17]);
+  values[6] = -100;
+  statistics.Reset();
+  statistics.AddValues(reinterpret_cast<uint8_t*>(values.data()),
+                       values.size());
+  thrift = statistics.ToThrift();
+  CHECK_EQ(DecodeStatistic<int32_t>(thrift.min_value), INT_MIN);
+  CHECK_EQ(DecodeStatistic<int32_t>(thrift.max_value), INT_MAX);
+  CHECK_EQ(DecodeStatistic<int32_t>(thrift.min), INT_MIN);
+}
+
+// Tests that the FLOAT and DOUBLE kernels skip NaNs wherever they are,
+// find extremes in the tail, and write zero bounds as -0.0 and +0.0.
+TEST(ColumnStatisticsTest, FloatingPointNaNsAndZeros) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  vector<float> floats;
+  for (int i = 0; i < 18; ++i) {
+    floats.push_back(i + 1);
+  }
+  floats[2] = 1e30f;
+  floats[7] = nan;
+  floats[16] = -3.5f;
+  floats[17] = nan;
+  ColumnStatistics statistics(parquet::Type::FLOAT);
+  statistics.AddValues(reinterpret_cast<uint8_t*>(floats.data()),
+                       floats.size());
+  parquet::Statistics thrift = statistics.ToThrift();
+  CHECK_EQ(DecodeStatistic<float>(thrift.min_value), -3.5f);
+  CHECK_EQ(DecodeStatistic<float>(thrift.max_value), 1e30f);
+
+  // Only NaNs: no min or max at all.
+  vector<float> nans(17, nan);
+  statistics.Reset();
+  statistics.AddValues(reinterpret_cast<uint8_t*>(nans.data()), nans.size());
+  CHECK(!statistics.HasMinMax());
+  CHECK(!statistics.ToThrift().__isset.min_value);
+
+  // A +0.0 min is written as -0.0, so it bounds both zeros.
+  for (float& value : floats) {
+    value = fabsf(value);
+  }
+  floats[16] = 0.0f;
+  statistics.Reset();
+  statistics.AddValues(reinterpret_cast<uint8_t*>(floats.data()),
+                       floats.size());
+  float min = DecodeStatistic<float>(statistics.ToThrift().min_value);
+  CHECK_EQ(min, 0.0f);
+  CHECK(signbit(min));
+
+  const double double_nan = std::numeric_limits<double>::quiet_NaN();
+  vector<double> doubles;
+  for (int i = 0; i < 17; ++i) {
+    doubles.push_back(-100.0 - i);
+  }
+  // The vector loop covers values 0 through 15; 16 is the tail.
+  doubles[3] = double_nan;
+  doubles[9] = -1000.0;
+  doubles[16] = -0.0;
+  ColumnStatistics double_statistics(parquet::Type::DOUBLE);
+  double_statistics.AddValues(reinterpret_cast<uint8_t*>(doubles.data()),
+                              doubles.size());
+  thrift = double_statistics.ToThrift();
+  CHECK_EQ(DecodeStatistic<double>(thrift.min_value), -1000.0);
+  double max = DecodeStatistic<double>(thrift.max_value);
+  CHECK_EQ(max, 0.0);
+  CHECK(!signbit(max));
+}
+
+// Tests the statistics written to each data page header and to the
+// column chunk metadata, for a chunk added as one batch.
+TEST_F(ParquetFileTest, PageAndChunkStatistics) {
+  ParquetFile output(&sink_);
+  ParquetColumn* scores =
+    new ParquetColumn({"Scores"}, parquet::Type::DOUBLE,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  // 17 values per page, so each page has a one value tail.
+  scores->setDataPageSize(17 * sizeof(double));
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({scores});
+  output.SetSchema(root_column);
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  vector<double> values;
+  for (int i = 0; i < 51; ++i) {
+    values.push_back(i * 0.5);
+  }
+  values[3] = nan;
+  values[16] = 100.0;
+  values[33] = -8.0;
+  values[40] = nan;
+  values[49] = nan;
+  values[50] = 200.0;
+  scores->AddRecords(values.data(), 0, values.size());
+  output.Flush();
+  CHECK_EQ(scores->NumDataPages(), 3);
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  const parquet::Statistics& chunk_statistics =
+      reader.ColumnChunkMetaData(0, 0).statistics;
+  CHECK_EQ(chunk_statistics.null_count, 0);
+  CHECK_EQ(DecodeStatistic<double>(chunk_statistics.min_value), -8.0);
+  CHECK_EQ(DecodeStatistic<double>(chunk_statistics.max_value), 200.0);
+
+  parquet::OffsetIndex offset_index;
+  CHECK(reader.ReadOffsetIndex(0, 0, &offset_index));
+  CHECK_EQ(offset_index.page_locations.size(), 3);
+  double page_mins[3] = { -0.0, -8.0, 17.0 };
+  double page_maxes[3] = { 100.0, 16.0, 200.0 };
+  for (int i = 0; i < 3; ++i) {
+    const parquet::PageLocation& location = offset_index.page_locations[i];
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> buffer(
+        new apache::thrift::transport::TMemoryBuffer(
+            const_cast<uint8_t*>(sink_.Contents().data()) + location.offset,
+            location.compressed_page_size,
+            apache::thrift::transport::TMemoryBuffer::OBSERVE));
+    apache::thrift::protocol::TCompactProtocol protocol(buffer);
+    parquet::PageHeader page_header;
+    page_header.read(&protocol);
+    const parquet::Statistics& page_statistics =
+        page_header.data_page_header.statistics;
+    CHECK(page_header.data_page_header.__isset.statistics);
+    CHECK_EQ(page_statistics.null_count, 0);
+    double min = DecodeStatistic<double>(page_statistics.min_value);
+    CHECK_EQ(min, page_mins[i]);
+    CHECK_EQ(signbit(min), signbit(page_mins[i]));
+    CHECK_EQ(DecodeStatistic<double>(page_statistics.max_value),
+             page_maxes[i]);
+  }
+}
+
+// Tests xxHash64 and the bits a value sets against known answers, and
+// that a view of an unaligned copy of the bitset probes the same.
+TEST(BloomFilterTest, KnownAnswers) {
+  const string empty;
+  const string abc("abc");
+  const string long_value("Nobody inspects the spammish repetition");
+  const uint8_t* abc_bytes = reinterpret_cast<const uint8_t*>(abc.data());
+  CHECK_EQ(BloomFilter::Hash(
+      reinterpret_cast<const uint8_t*>(empty.data()), 0),
+           0xef46db3751d8e999ULL);
+  CHECK_EQ(BloomFilter::Hash(abc_bytes, 1), 0xd24ec4f1a98c6e5bULL);
+  CHECK_EQ(BloomFilter::Hash(abc_bytes, 3), 0x44bc2cf5ad770999ULL);
+  CHECK_EQ(BloomFilter::Hash(
+      reinterpret_cast<const uint8_t*>(long_value.data()), long_value.size()),
+           0xfbcea83c8a378bf1ULL);
+
+  // 32 blocks: "abc" hashes to block 8, and sets these bits in its
+  // eight words.
+  BloomFilter filter(1024);
+  filter.Insert(BloomFilter::Hash(abc_bytes, 3));
+  const int abc_bits[8] = { 13, 11, 23, 21, 6, 14, 29, 29 };
+  vector<uint32_t> words(256);
+  memcpy(words.data(), filter.Bitset(), filter.NumBytes());
+  for (int i = 0; i < 256; ++i) {
+    uint32_t expected = i / 8 == 8 ? 1U << abc_bits[i % 8] : 0;
+    CHECK_EQ(words[i], expected) << "word " << i;
+  }
+
+  vector<uint8_t> unaligned(filter.NumBytes() + 1);
+  memcpy(&unaligned[1], filter.Bitset(), filter.NumBytes());
+  BloomFilterView view(&unaligned[1], filter.NumBytes());
+  CHECK(view.MightContain(BloomFilter::Hash(abc_bytes, 3)));
+  // "a" hashes to block 26, which is empty.
+  CHECK(!view.MightContain(BloomFilter::Hash(abc_bytes, 1)));
+  CHECK(!filter.MightContain(BloomFilter::Hash(abc_bytes, 1)));
+}
+
+// Tests that a column's Bloom filter holds every value written to it,
+// and that scans for a value it rules out skip the row group even when
+// the statistics can't.
+TEST_F(ParquetFileTest, BloomFilterRulesOutMissingValues) {
+  ParquetFile output(&sink_);
+  ParquetColumn* names =
+    new ParquetColumn({"Names"}, parquet::Type::BYTE_ARRAY,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  names->EnableBloomFilter(1000);
+  ParquetColumn* positions =
+    new ParquetColumn({"Positions"}, parquet::Type::INT64,
+                      0, 0,
+                      FieldRepetitionType::REQUIRED,
+                      Encoding::PLAIN,
+                      CompressionCodec::UNCOMPRESSED);
+  ParquetColumn* root_column =
+    new ParquetColumn({"root"}, FieldRepetitionType::REQUIRED);
+  root_column->SetChildren({names, positions});
+  output.SetSchema(root_column);
+  for (int64_t i = 0; i < 1000; ++i) {
+    string name = "read" + to_string(i * 2);
+    names->AddVariableLengthByteArray(&name[0], 0, name.size());
+    positions->AddRecords(&i, 0, 1);
+  }
+  output.Flush();
+
+  ParquetFileReader reader(sink_.Contents().data(), sink_.Contents().size());
+  CHECK(reader.IsOK());
+  CHECK(reader.ColumnChunkMetaData(0, 0).__isset.bloom_filter_offset);
+  CHECK(!reader.ColumnChunkMetaData(0, 1).__isset.bloom_filter_offset);
+  std::unique_ptr<BloomFilter> filter;
+  CHECK(reader.ReadBloomFilter(0, 0, &filter));
+  CHECK(!reader.ReadBloomFilter(0, 1, &filter));
+  int false_positives = 0;
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(reader.RowGroupMightContain(0, "Names", "read" + to_string(i * 2)));
+    false_positives += reader.RowGroupMightContain(
+        0, "Names", "read" + to_string(i * 2 + 1));
+  }
+  CHECK_LT(false_positives, 50);
+  // Chunks without a filter might contain anything.
+  CHECK(reader.RowGroupMightContain(0, "Positions", string(8, 'x')));
+
+  int row_groups_read = 0;
+  auto count_row_groups = [&row_groups_read]
+      (int row_group, const vector<ColumnChunkData>& columns) {
+    ++row_groups_read;
+    return true;
+  };
+  // An odd name the filter rules out; it's within the statistics'
+  // range, so only the filter can skip the row group.
+  int missing = 1;
+  while (reader.RowGroupMightContain(0, "Names",
+                                     "read" + to_string(missing))) {
+    missing += 2;
+  }
+  string missing_name = "read" + to_string(missing);
+  CHECK(reader.Scan({"Positions"},
+                    {RangePredicate::Between("Names", "read2", "read2")},
+                    count_row_groups));
+  CHECK_EQ(row_groups_read, 1);
+  CHECK(reader.Scan({"Positions"},
+                    {RangePredicate::Between("Names", missing_name,
+                                             missing_name)},
+                    count_row_groups));
+  CHECK_EQ(row_groups_read, 1);
+}
+
+// Tests that chunk statistics rule out predicates outside their range,
+// and that chunks without usable statistics are never ruled out.
+TEST(ParquetFileReaderTest, StatisticsPruneChunks) {
+  SchemaElement element;
+  element.__set_type(parquet::Type::INT32);
+  ColumnMetaData metadata;
+  metadata.__set_num_values(100);
+  RangePredicate predicate = RangePredicate::Between<int32_t>("x", 10, 20);
+  CHECK(ParquetFileReader::ChunkMightMatch(element, metadata, predicate));
+
+  parquet::Statistics statistics;
+  int32_t min = -5, max = 9;
+  statistics.__set_min_value(string(reinterpret_cast<char*>(&min), 4));
+  statistics.__set_max_value(string(reinterpret_cast<char*>(&max), 4));
+  metadata.__set_statistics(statistics);
+  CHECK(!ParquetFileReader::ChunkMightMatch(element, metadata, predicate));
+  CHECK(ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::AtMost<int32_t>("x", -5)));
+  CHECK(!ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::AtMost<int32_t>("x", -6)));
+
+  statistics.__set_null_count(100);
+  metadata.__set_statistics(statistics);
+  CHECK(!ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::AtLeast<int32_t>("x", 0)));
+
+  // Byte arrays compare as unsigned bytes.
+  element.__set_type(parquet::Type::BYTE_ARRAY);
+  statistics = parquet::Statistics();
+  statistics.__set_min_value("chr1");
+  statistics.__set_max_value("chr9");
+  metadata.__set_statistics(statistics);
+  CHECK(ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::Between("x", "chr2", "chr2")));
+  CHECK(!ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::AtLeast("x", "chrX")));
+  CHECK(!ParquetFileReader::ChunkMightMatch(
+      element, metadata, RangePredicate::AtMost("x", "chr")));
+}
+
+// Tests that ranges reserved from several threads at once don't
+// overlap, and that each write lands where it was reserved.
+TEST(PositionedWriterTest, ConcurrentReservesAndWrites) {
+  char filename[] = "/tmp/parquetFileTmp.XXXXXX";
+  int fd = mkstemp(filename);
+  CHECK_NE(fd, -1);
+  PositionedWriter writer(fd, 0);
+  const int kThreads = 8;
+  const int kWritesPerThread = 500;
+  const int kWriteSize = 100;
+  vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(std::thread([&writer, t] () {
+          vector<uint8_t> data(kWriteSize, 'a' + t);
+          for (int i = 0; i < kWritesPerThread; ++i) {
+            vector<struct iovec> iovecs(2);
+            iovecs[0].iov_base = data.data();
+            iovecs[0].iov_len = 40;
+            iovecs[1].iov_base = data.data() + 40;
+            iovecs[1].iov_len = kWriteSize - 40;
+            off_t offset = writer.Reserve(kWriteSize);
+            CHECK_EQ(offset % kWriteSize, 0);
+            CHECK_EQ(writer.WriteAt(offset, &iovecs), kWriteSize);
+          }
+        }));
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  const size_t kFileSize = kThreads * kWritesPerThread * kWriteSize;
+  CHECK_EQ(writer.Size(), kFileSize);
+  vector<uint8_t> contents(kFileSize);
+  CHECK_EQ(pread(fd, contents.data(), kFileSize, 0), kFileSize);
+  close(fd);
+  unlink(filename);
+  vector<int> writes_per_thread(kThreads);
+  for (size_t i = 0; i < kFileSize; i += kWriteSize) {
+    CHECK(std::all_of(contents.begin() + i, contents.begin() + i + kWriteSize,
+                      [&contents, i] (uint8_t c) { return c == contents[i]; }))
+        << "Writes overlapped at offset " << i;
+    ++writes_per_thread[contents[i] - 'a'];
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    CHECK_EQ(writes_per_thread[t], kWritesPerThread);
+  }
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
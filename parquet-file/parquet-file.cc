@@ -7,15 +7,17 @@
 #include <glog/logging.h>
 #include <parquet_types.h>
 #include <thrift/protocol/TCompactProtocol.h>
-#include <thrift/transport/TFDTransport.h>
 #include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 
+#include <algorithm>
 #include <set>
 #include <string>
+#include <thread>
 
-using apache::thrift::transport::TFDTransport;
 using apache::thrift::protocol::TCompactProtocol;
 using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::transport::TMemoryBuffer;
 using parquet::ColumnChunk;
 using parquet::ColumnMetaData;
 using parquet::CompressionCodec;
@@ -34,29 +36,100 @@ const char* kParquetMagicBytes = "PAR1";
 
 namespace parquet_file {
 
-ParquetFile::ParquetFile(string file_base, int num_files) {
-  // TODO: remove this restrction
-  assert(num_files == 1);
+namespace {
+
+// 64-bit FNV-1a of the length bytes of a record's data at data.
+// Whether the record is null (data is nullptr) is hashed too, so a
+// null and an empty value don't collide.
+uint64_t HashRecord(const uint8_t* data, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  auto add_byte = [&hash] (uint8_t b) {
+    hash ^= b;
+    hash *= 1099511628211ULL;
+  };
+  add_byte(data == nullptr);
+  for (size_t i = 0; data != nullptr && i < length; ++i) {
+    add_byte(data[i]);
+  }
+  return hash;
+}
+
+}  // namespace
+
+ParquetFile::ParquetFile(string file_base, int num_files)
+  : num_rows_written_(0),
+    row_group_size_in_bytes_(kMaxDataBytesPerRowGroup),
+    num_encoding_threads_(std::max(1U, std::thread::hardware_concurrency())),
+    num_files_(num_files),
+    sink_(nullptr),
+    sharding_policy_(ROUND_ROBIN),
+    shard_key_column_index_(-1),
+    first_record_shard_(0) {
+  CHECK_GT(num_files, 0) << "Need at least one output file";
 
   ok_ = false;
 
-  fd_ = open(file_base.c_str(), O_RDWR | O_CREAT | O_EXCL, 0700);
-  LOG_IF(FATAL, fd_ == -1) << "Could not create file " << file_base.c_str()
-                           << ": " << strerror(errno);
-  // Write magic header
-  write(fd_, kParquetMagicBytes, strlen(kParquetMagicBytes));
+  if (num_files > 1) {
+    // Each shard is a complete single-file writer with its own writer
+    // thread; this object only routes records to them.  Split the
+    // encoding threads between the shards, since they write at the
+    // same time.
+    int shard_encoding_threads = std::max(1, num_encoding_threads_ / num_files);
+    for (int i = 0; i < num_files; ++i) {
+      shards_.emplace_back(
+          new ParquetFile(ShardFileName(file_base, i, num_files)));
+      shards_.back()->SetNumEncodingThreads(shard_encoding_threads);
+      shard_writers_.emplace_back(new WorkerPool(1));
+    }
+    shard_writing_.assign(num_files, false);
+    ok_ = true;
+    return;
+  }
 
-  // Construct transports (provided by Thrift) for writing to the
-  // file.
-  file_transport_.reset(new TFDTransport(fd_));
-  protocol_.reset(new TCompactProtocol(file_transport_));
+  owned_sink_.reset(new FileSink(file_base));
+  sink_ = owned_sink_.get();
+  StartEncodingPool();
+  StartFile();
+}
+
+ParquetFile::ParquetFile(ParquetSink* sink)
+  : num_rows_written_(0),
+    row_group_size_in_bytes_(kMaxDataBytesPerRowGroup),
+    num_encoding_threads_(std::max(1U, std::thread::hardware_concurrency())),
+    num_files_(1),
+    sink_(CHECK_NOTNULL(sink)),
+    sharding_policy_(ROUND_ROBIN),
+    shard_key_column_index_(-1),
+    first_record_shard_(0),
+    ok_(false) {
+  StartEncodingPool();
+  StartFile();
+}
+
+void ParquetFile::StartEncodingPool() {
+  // Replacing a pool joins its threads, which are idle between row
+  // groups.
+  encoding_pool_.reset(num_encoding_threads_ > 1 ?
+                       new WorkerPool(num_encoding_threads_) : nullptr);
+}
+
+void ParquetFile::StartFile() {
+  // Write magic header
+  LOG_IF(FATAL, !sink_->Write(kParquetMagicBytes, strlen(kParquetMagicBytes)))
+      << "Could not write magic bytes";
 
   // Parquet-specific metadata for the file.
   file_meta_data_.__set_version(1);
   file_meta_data_.__set_created_by("Neal sid");
 
   ok_ = true;
-  return;
+}
+
+string ParquetFile::ShardFileName(const string& file_base, int shard_index,
+                                  int num_files) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "-%05d-of-%05d", shard_index, num_files);
+  return file_base + suffix;
 }
 
 void ParquetFile::DepthFirstSchemaTraversal(ParquetColumn* root_column,
@@ -102,28 +175,269 @@ uint64_t ParquetFile::BytesForRecord(uint64_t record_index) const {
 }
 
 uint32_t ParquetFile::CalculateNumberOfRowGroups() const {
-  uint64_t byte_total = 0;
-  uint32_t row_groups = 0;
   uint64_t number_of_records = NumberOfRecords();
-  for (int i = 0; i < number_of_records; ++i) {
-    byte_total += BytesForRecord(i);
-    if (byte_total > kMaxDataBytesPerRowGroup) {
-      ++row_groups;
-      byte_total = 0;
+  vector<ParquetColumn*> leaf_columns;
+  LeafColumns(&leaf_columns);
+  // Estimated size of records 0 through record_index in all columns.
+  auto size_through = [&leaf_columns] (uint64_t record_index) {
+    uint64_t size = 0;
+    for (ParquetColumn* column : leaf_columns) {
+      size += column->CumulativeSizeInBytes(record_index);
+    }
+    return size;
+  };
+
+  // A row group ends with the first record that takes it over the
+  // row group size.  Sizes only grow with the record index, so that
+  // record can be binary searched for.
+  uint32_t row_groups = 0;
+  uint64_t group_start = 0;
+  uint64_t bytes_before_group = 0;
+  while (group_start < number_of_records) {
+    uint64_t low = group_start;
+    uint64_t high = number_of_records;
+    while (low < high) {
+      uint64_t middle = low + (high - low) / 2;
+      if (size_through(middle) - bytes_before_group >
+          row_group_size_in_bytes_) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
     }
+    if (low == number_of_records) {
+      // The rest of the records don't fill a row group.
+      break;
+    }
+    ++row_groups;
+    bytes_before_group = size_through(low);
+    group_start = low + 1;
   }
   return row_groups;
 }
 
-void ParquetFile::Flush() {
+uint32_t ParquetFile::NumberOfRowGroupsWritten() const {
+  uint32_t num_row_groups = row_groups_.size();
+  for (const auto& shard : shards_) {
+    num_row_groups += shard->NumberOfRowGroupsWritten();
+  }
+  return num_row_groups;
+}
+
+uint64_t ParquetFile::NumberOfRecordsWrittenToFile(int file_index) const {
+  CHECK_LT(file_index, num_files_) << "No such file: " << file_index;
+  if (shards_.empty()) {
+    return num_rows_written_;
+  }
+  return shards_[file_index]->NumberOfRecordsWrittenToFile(0);
+}
+
+void ParquetFile::SetRowGroupSizeInBytes(uint64_t row_group_size_in_bytes) {
+  CHECK_GT(row_group_size_in_bytes, 0) << "Row group size must be positive";
+  row_group_size_in_bytes_ = row_group_size_in_bytes;
+  for (auto& shard : shards_) {
+    shard->SetRowGroupSizeInBytes(row_group_size_in_bytes);
+  }
+}
+
+void ParquetFile::SetShardingPolicy(ShardingPolicy policy,
+                                    const string& key_column_path) {
+  sharding_policy_ = policy;
+  shard_key_column_index_ = -1;
+  if (policy != HASH_KEY_COLUMN) {
+    return;
+  }
+  LOG_IF(FATAL, file_columns_.size() == 0) <<
+    "Set the schema before the sharding key column";
+  vector<ParquetColumn*> leaf_columns;
+  LeafColumns(&leaf_columns);
+  for (int i = 0; i < leaf_columns.size(); ++i) {
+    if (leaf_columns[i]->FullSchemaPath() == key_column_path) {
+      shard_key_column_index_ = i;
+    }
+  }
+  LOG_IF(FATAL, shard_key_column_index_ == -1) <<
+    "No leaf column named " << key_column_path << " to shard by";
+}
+
+uint64_t ParquetFile::BufferedDataSizeInBytes() const {
+  return BufferedDataSizeInBytes(file_columns_);
+}
+
+uint64_t ParquetFile::BufferedDataSizeInBytes(
+    const vector<ParquetColumn*>& file_columns) {
+  uint64_t buffered_bytes = 0;
+  for (auto column = file_columns.begin() + 1;
+       column != file_columns.end();
+       ++column) {
+    if ((*column)->Children().size() == 0) {
+      buffered_bytes += (*column)->EstimatedSizeInBytes();
+    }
+  }
+  return buffered_bytes;
+}
+
+bool ParquetFile::MaybeFlushRowGroup() {
   LOG_IF(FATAL, file_columns_.size() == 0) <<
     "No columns to flush";
-  off_t current_offset = lseek(fd_, 0, SEEK_CUR);
-  // Make sure we know where we are in the file.  Also serves as a
-  // somewhat weak guarantee that someone else hasn't written to the
-  // file already.
-  VLOG(2) << "Offset at beginning of flush: " << to_string(current_offset);
-  assert(current_offset == strlen(kParquetMagicBytes));
+  if (!shards_.empty()) {
+    return FlushFullShards();
+  }
+  if (BufferedDataSizeInBytes() < row_group_size_in_bytes_) {
+    return false;
+  }
+  set<uint64_t> column_record_counts;
+  NumberOfRecords(&column_record_counts);
+  if (column_record_counts.size() > 1) {
+    // We're in the middle of a record; a row group can't end here.
+    VLOG(2) << "Columns have different numbers of records, "
+            << "not flushing row group";
+    return false;
+  }
+  FlushRowGroup();
+  ResetColumns();
+  return true;
+}
+
+void ParquetFile::LeafColumns(vector<ParquetColumn*>* leaf_columns) const {
+  LeafColumns(file_columns_, leaf_columns);
+}
+
+void ParquetFile::LeafColumns(const vector<ParquetColumn*>& file_columns,
+                              vector<ParquetColumn*>* leaf_columns) {
+  CHECK_NOTNULL(leaf_columns);
+  leaf_columns->clear();
+  for (auto column_iter = file_columns.begin() + 1 ;
+       column_iter != file_columns.end();
+       ++column_iter) {
+    auto column = *column_iter;
+    if (column->Children().size() > 0) {
+      VLOG(3) << "Skipping column because it's non-leaf: " <<
+        column->FullSchemaPath();
+      continue;
+    }
+    leaf_columns->push_back(column);
+  }
+}
+
+ParquetColumn* ParquetFile::CloneSchema(
+    const ParquetColumn* column, vector<ParquetColumn*>* clone_columns) {
+  ParquetColumn* clone = column->CloneWithoutData();
+  shard_columns_.emplace_back(clone);
+  clone_columns->push_back(clone);
+  for (const ParquetColumn* child : column->Children()) {
+    clone->AddChild(CloneSchema(child, clone_columns));
+  }
+  return clone;
+}
+
+void ParquetFile::RouteRecordsToShards() {
+  vector<ParquetColumn*> leaf_columns;
+  LeafColumns(&leaf_columns);
+  // The router picks a ShardColumnSet(), so each leaf column is routed
+  // to its copies in all of them, in that order.
+  vector<vector<ParquetColumn*>> shard_leaf_columns(
+      shard_file_columns_.size());
+  for (int i = 0; i < shard_file_columns_.size(); ++i) {
+    LeafColumns(shard_file_columns_[i], &shard_leaf_columns[i]);
+  }
+  for (int c = 0; c < leaf_columns.size(); ++c) {
+    vector<ParquetColumn*> shard_columns;
+    for (int i = 0; i < shard_leaf_columns.size(); ++i) {
+      shard_columns.push_back(shard_leaf_columns[i][c]);
+    }
+    leaf_columns[c]->RouteRecordsTo(
+        shard_columns,
+        [this, c] (uint64_t record_index, const uint8_t* data, size_t length) {
+          return ShardForRecord(c, record_index, data, length);
+        });
+  }
+}
+
+int ParquetFile::ShardForRecord(int column_index, uint64_t record_index,
+                                const uint8_t* data, size_t length) {
+  int shard;
+  if (sharding_policy_ != HASH_KEY_COLUMN) {
+    shard = record_index % shards_.size();
+  } else if (column_index == shard_key_column_index_) {
+    DCHECK_EQ(record_index, first_record_shard_ + record_shards_.size());
+    shard = HashRecord(data, length) % shards_.size();
+    record_shards_.push_back(shard);
+  } else {
+    LOG_IF(FATAL, record_index < first_record_shard_ ||
+           record_index - first_record_shard_ >= record_shards_.size())
+        << "Record " << record_index << " was added to leaf column "
+        << column_index << " before its key";
+    shard = record_shards_[record_index - first_record_shard_];
+  }
+  return ShardColumnSet(shard, shard_filling_column_set_[shard]);
+}
+
+void ParquetFile::WaitForShard(int shard) {
+  if (shard_writing_[shard]) {
+    shard_writers_[shard]->Wait();
+    shard_writing_[shard] = false;
+  }
+}
+
+bool ParquetFile::FlushFullShards() {
+  vector<ParquetColumn*> leaf_columns;
+  LeafColumns(&leaf_columns);
+  for (ParquetColumn* column : leaf_columns) {
+    if (column->NumRoutedRecords() != leaf_columns[0]->NumRoutedRecords()) {
+      // We're in the middle of a record; a row group can't end here.
+      VLOG(2) << "Columns have different numbers of records, "
+              << "not flushing row groups";
+      return false;
+    }
+  }
+  // Every column of the records keyed so far has been routed, so
+  // their shards aren't needed any more.
+  first_record_shard_ += record_shards_.size();
+  record_shards_.clear();
+
+  bool flushing = false;
+  for (int i = 0; i < shards_.size(); ++i) {
+    int column_set = shard_filling_column_set_[i];
+    const vector<ParquetColumn*>* filled_columns =
+        &shard_file_columns_[ShardColumnSet(i, column_set)];
+    if (BufferedDataSizeInBytes(*filled_columns) < row_group_size_in_bytes_) {
+      continue;
+    }
+    // Records go to the other copy of the schema from here on, so the
+    // writer has to be done with it.
+    WaitForShard(i);
+    VLOG(2) << "Writing a row group of file " << i;
+    ParquetFile* shard = shards_[i].get();
+    shard_writers_[i]->Post([shard, filled_columns] () {
+        shard->file_columns_ = *filled_columns;
+        shard->FlushRowGroup();
+        shard->ResetColumns();
+      });
+    shard_writing_[i] = true;
+    shard_filling_column_set_[i] = 1 - column_set;
+    flushing = true;
+  }
+  return flushing;
+}
+
+void ParquetFile::ResetColumns() {
+  for (auto column = file_columns_.begin() + 1;
+       column != file_columns_.end();
+       ++column) {
+    if ((*column)->Children().size() == 0) {
+      (*column)->Reset();
+    }
+  }
+}
+
+void ParquetFile::FlushRowGroup() {
+  if (row_groups_.empty()) {
+    // The only thing before the first row group is the magic header.
+    VLOG(2) << "Offset at beginning of first row group: "
+            << to_string(sink_->Tell());
+    CHECK_EQ(sink_->Tell(), strlen(kParquetMagicBytes));
+  }
 
   set<uint64_t> column_record_counts;
   NumberOfRecords(&column_record_counts);
@@ -134,46 +448,294 @@ void ParquetFile::Flush() {
   uint64_t num_records = *(column_record_counts.begin());
   LOG_IF(WARNING,  num_records == 0)
     << "Number of records in first leaf-node column is 0";
-  VLOG(2) << "Number of records of data: " << num_records;
-  file_meta_data_.__set_num_rows(num_records);
+  VLOG(2) << "Number of records of data in row group "
+          << row_groups_.size() << ": " << num_records;
+
+  vector<ParquetColumn*> leaf_columns;
+  LeafColumns(&leaf_columns);
+  EncodeColumnChunks(leaf_columns);
+
+  // The chunks are laid out in schema order, each starting where the
+  // one before it ends.  Now that they're encoded their sizes are
+  // known, so if the sink supports positioned writes the whole row
+  // group's range is reserved at once, and each chunk's offset follows
+  // from it.  Otherwise the row group goes wherever the sink is up to.
+  uint64_t row_group_bytes = 0;
+  for (ParquetColumn* column : leaf_columns) {
+    row_group_bytes += column->EncodedSizeInBytes();
+  }
+  PositionedWriter* writer = sink_->GetPositionedWriter();
+  off_t row_group_offset =
+      writer ? writer->Reserve(row_group_bytes) : sink_->Tell();
+  vector<off_t> column_offsets;
+  off_t column_offset = row_group_offset;
+  for (ParquetColumn* column : leaf_columns) {
+    column_offsets.push_back(column_offset);
+    column_offset += column->EncodedSizeInBytes();
+  }
+  WriteColumnChunks(leaf_columns, row_group_offset, column_offsets);
 
   RowGroup row_group;
   row_group.__set_num_rows(num_records);
   vector<ColumnChunk> column_chunks;
-  for (auto column_iter = file_columns_.begin() + 1 ;
-       column_iter != file_columns_.end();
-       ++column_iter) {
-    auto column = *column_iter;
-    if (column->Children().size() > 0) {
-      VLOG(3) << "Skipping column because it's non-leaf: " <<
-        column->FullSchemaPath();
-      continue;
-    }
-    VLOG(2) << "Writing column: " << column->FullSchemaPath();
+  column_indexes_.push_back(vector<parquet::ColumnIndex>());
+  offset_indexes_.push_back(vector<parquet::OffsetIndex>());
+  for (ParquetColumn* column : leaf_columns) {
+    VLOG(2) << "Wrote column: " << column->FullSchemaPath();
     VLOG(2) << "\t" << column->ToString();
-    VLOG(2) << "\t" << "Writing " << num_records << " records";
-    column->Flush(fd_, protocol_.get());
+    VLOG(2) << "\t" << "Wrote " << num_records << " records";
     ColumnMetaData column_metadata = column->ParquetColumnMetaData();
     row_group.__set_total_byte_size(row_group.total_byte_size +
                                     column_metadata.total_uncompressed_size);
-    VLOG(2) << "Wrote " << to_string(column_metadata.total_uncompressed_size)
+    VLOG(2) << "Column chunk of "
+            << to_string(column_metadata.total_compressed_size)
             << " bytes for column: " << column->FullSchemaPath();
     ColumnChunk column_chunk;
     column_chunk.__set_file_path(file_base_.c_str());
     column_chunk.__set_file_offset(column_metadata.data_page_offset);
     column_chunk.__set_meta_data(column_metadata);
     column_chunks.push_back(column_chunk);
+    column_indexes_.back().push_back(column->HasColumnIndex() ?
+                                     column->ParquetColumnIndex() :
+                                     parquet::ColumnIndex());
+    offset_indexes_.back().push_back(column->ParquetOffsetIndex());
   }
   VLOG(2) << "Total bytes for all columns: " << row_group.total_byte_size;
+  WriteBloomFilters(leaf_columns, &column_chunks);
   row_group.__set_columns(column_chunks);
 
-  file_meta_data_.__set_row_groups({row_group});
-  uint32_t file_metadata_length = file_meta_data_.write(protocol_.get());
-  VLOG(2) << "File metadata length: " << file_metadata_length;
-  write(fd_, &file_metadata_length, sizeof(file_metadata_length));
-  write(fd_, kParquetMagicBytes, strlen(kParquetMagicBytes));
+  row_groups_.push_back(row_group);
+  num_rows_written_ += num_records;
+}
+
+void ParquetFile::ForEachColumnInParallel(
+    const vector<ParquetColumn*>& columns,
+    const function<void(size_t)>& callback) {
+  if (!encoding_pool_ || columns.size() <= 1) {
+    for (size_t c = 0; c < columns.size(); ++c) {
+      callback(c);
+    }
+    return;
+  }
+  encoding_pool_->ForEach(columns.size(), callback);
+}
+
+void ParquetFile::EncodeColumnChunks(const vector<ParquetColumn*>& columns) {
+  VLOG(2) << "Encoding " << columns.size() << " column chunks on up to "
+          << num_encoding_threads_ << " threads";
+  ForEachColumnInParallel(columns, [&columns] (size_t c) {
+      columns[c]->EncodeColumnChunk();
+    });
+}
+
+void ParquetFile::WriteColumnChunks(const vector<ParquetColumn*>& columns,
+                                    off_t row_group_offset,
+                                    const vector<off_t>& column_offsets) {
+  PositionedWriter* writer = sink_->GetPositionedWriter();
+  if (writer && num_encoding_threads_ > 1 && !async_writer_) {
+    // The chunks' ranges don't overlap, so each thread writes the
+    // chunks it takes straight to their place in the file.
+    ForEachColumnInParallel(columns, [writer, &columns, &column_offsets]
+                            (size_t c) {
+        columns[c]->WriteColumnChunk(writer, column_offsets[c]);
+      });
+    return;
+  }
+  // Otherwise, gathering every chunk into a single write beats a call
+  // per chunk.
+  vector<struct iovec> iovecs;
+  uint64_t row_group_bytes = 0;
+  for (size_t c = 0; c < columns.size(); ++c) {
+    columns[c]->GetColumnChunkIovecs(column_offsets[c], &iovecs);
+    row_group_bytes += columns[c]->EncodedSizeInBytes();
+  }
+  if (async_writer_) {
+    // The row group is copied, so the columns can be reset and
+    // refilled while it's written.
+    async_writer_->WriteAt(row_group_offset, iovecs);
+    return;
+  }
+  if (writer) {
+    ssize_t written = writer->WriteAt(row_group_offset, &iovecs);
+    LOG_IF(FATAL, written != row_group_bytes)
+        << "Did not write correct number of bytes for row group: "
+        << written << "/" << row_group_bytes;
+  } else {
+    LOG_IF(FATAL, !sink_->Write(iovecs))
+        << "Could not write row group of " << row_group_bytes << " bytes";
+  }
+}
+
+void ParquetFile::WriteBloomFilters(const vector<ParquetColumn*>& columns,
+                                    vector<ColumnChunk>* column_chunks) {
+  vector<struct iovec> iovecs;
+  vector<size_t> filter_bytes(columns.size(), 0);
+  uint64_t total_bytes = 0;
+  for (size_t c = 0; c < columns.size(); ++c) {
+    if (columns[c]->HasBloomFilter()) {
+      filter_bytes[c] = columns[c]->GetBloomFilterIovecs(&iovecs);
+      total_bytes += filter_bytes[c];
+    }
+  }
+  if (total_bytes == 0) {
+    return;
+  }
+  PositionedWriter* writer = sink_->GetPositionedWriter();
+  off_t filters_offset = writer ? writer->Reserve(total_bytes) : sink_->Tell();
+  off_t filter_offset = filters_offset;
+  for (size_t c = 0; c < columns.size(); ++c) {
+    if (filter_bytes[c] > 0) {
+      (*column_chunks)[c].meta_data.__set_bloom_filter_offset(filter_offset);
+      filter_offset += filter_bytes[c];
+    }
+  }
+  VLOG(2) << "Writing " << total_bytes << " bytes of Bloom filters at "
+          << filters_offset;
+  if (async_writer_) {
+    async_writer_->WriteAt(filters_offset, iovecs);
+  } else if (writer) {
+    ssize_t written = writer->WriteAt(filters_offset, &iovecs);
+    LOG_IF(FATAL, written != total_bytes)
+        << "Did not write correct number of bytes for Bloom filters: "
+        << written << "/" << total_bytes;
+  } else {
+    LOG_IF(FATAL, !sink_->Write(iovecs))
+        << "Could not write " << total_bytes << " bytes of Bloom filters";
+  }
+}
+
+void ParquetFile::SetNumEncodingThreads(int num_encoding_threads) {
+  CHECK_GT(num_encoding_threads, 0) << "Need at least one encoding thread";
+  num_encoding_threads_ = num_encoding_threads;
+  if (shards_.empty()) {
+    StartEncodingPool();
+  }
+  for (auto& shard : shards_) {
+    shard->SetNumEncodingThreads(
+        std::max<int>(1, num_encoding_threads / shards_.size()));
+  }
+}
+
+void ParquetFile::Flush() {
+  LOG_IF(FATAL, file_columns_.size() == 0) <<
+    "No columns to flush";
+
+  if (!shards_.empty()) {
+    // Each shard's writer finishes any row group it's writing, then
+    // writes the rest of the shard's records and its footer.
+    for (int i = 0; i < shards_.size(); ++i) {
+      ParquetFile* shard = shards_[i].get();
+      const vector<ParquetColumn*>* last_columns =
+          &shard_file_columns_[ShardColumnSet(i, shard_filling_column_set_[i])];
+      shard_writers_[i]->Post([shard, last_columns] () {
+          shard->file_columns_ = *last_columns;
+          shard->Flush();
+        });
+      shard_writing_[i] = true;
+    }
+    for (int i = 0; i < shards_.size(); ++i) {
+      WaitForShard(i);
+    }
+    VLOG(2) << "Done.";
+    return;
+  }
+
+  // Whatever is still buffered goes in the last row group.  If
+  // nothing has been written yet, we still write a (possibly empty)
+  // row group, as we always have.
+  if (row_groups_.empty() || NumberOfRecords() > 0) {
+    FlushRowGroup();
+  }
+  VLOG(2) << "Number of records of data: " << num_rows_written_;
+  file_meta_data_.__set_num_rows(num_rows_written_);
+  WritePageIndexes();
+  file_meta_data_.__set_row_groups(row_groups_);
+  WriteFooter();
+  LOG_IF(FATAL, !sink_->Close()) << "Could not close the output";
   VLOG(2) << "Done.";
-  close(fd_);
+}
+
+void ParquetFile::SetAsyncOutput(int num_buffers, int queue_depth) {
+  for (auto& shard : shards_) {
+    shard->SetAsyncOutput(num_buffers, queue_depth);
+  }
+  if (!shards_.empty()) {
+    return;
+  }
+  LOG_IF(FATAL, !row_groups_.empty())
+      << "Asynchronous output must be set up before writing row groups";
+  PositionedWriter* writer = sink_->GetPositionedWriter();
+  LOG_IF(FATAL, writer == nullptr)
+      << "Asynchronous output needs a sink that supports positioned writes";
+  async_writer_.reset(new AsyncWriter(writer, num_buffers, queue_depth));
+}
+
+void ParquetFile::WritePageIndexes() {
+  // The column indexes of all the chunks go first, then their offset
+  // indexes, which is the layout the format recommends.  Readers find
+  // them through the offsets and lengths in each ColumnChunk, so they
+  // all go out in one write.
+  std::shared_ptr<TMemoryBuffer> index_buffer(new TMemoryBuffer());
+  TCompactProtocol protocol(index_buffer);
+  uint64_t offset = sink_->Tell();
+  for (int r = 0; r < row_groups_.size(); ++r) {
+    for (int c = 0; c < row_groups_[r].columns.size(); ++c) {
+      if (column_indexes_[r][c].null_pages.empty()) {
+        continue;
+      }
+      uint32_t length = column_indexes_[r][c].write(&protocol);
+      row_groups_[r].columns[c].__set_column_index_offset(offset);
+      row_groups_[r].columns[c].__set_column_index_length(length);
+      offset += length;
+    }
+  }
+  for (int r = 0; r < row_groups_.size(); ++r) {
+    for (int c = 0; c < row_groups_[r].columns.size(); ++c) {
+      uint32_t length = offset_indexes_[r][c].write(&protocol);
+      row_groups_[r].columns[c].__set_offset_index_offset(offset);
+      row_groups_[r].columns[c].__set_offset_index_length(length);
+      offset += length;
+    }
+  }
+  uint8_t* indexes;
+  uint32_t indexes_length;
+  index_buffer->getBuffer(&indexes, &indexes_length);
+  CHECK_EQ(sink_->Tell() + indexes_length, offset);
+  LOG_IF(FATAL, !sink_->Write(indexes, indexes_length))
+      << "Could not write the page indexes";
+  VLOG(2) << "Wrote " << indexes_length << " bytes of page indexes";
+  column_indexes_.clear();
+  offset_indexes_.clear();
+}
+
+void ParquetFile::WriteFooter() {
+  // The footer's offsets are only right if every row group made it
+  // to the file.
+  if (async_writer_) {
+    async_writer_->WaitForCompletions();
+  }
+  // The footer is the file metadata, its length and the magic bytes.
+  // The metadata is serialized into memory first so that the whole
+  // footer goes out in one write, rather than a write per field.
+  std::shared_ptr<TMemoryBuffer> footer_buffer(new TMemoryBuffer());
+  TCompactProtocol protocol(footer_buffer);
+  uint32_t file_metadata_length = file_meta_data_.write(&protocol);
+  VLOG(2) << "File metadata length: " << file_metadata_length;
+  uint8_t* file_metadata;
+  uint32_t buffered_length;
+  footer_buffer->getBuffer(&file_metadata, &buffered_length);
+  CHECK_EQ(buffered_length, file_metadata_length);
+
+  vector<struct iovec> iovecs(3);
+  iovecs[0].iov_base = file_metadata;
+  iovecs[0].iov_len = file_metadata_length;
+  iovecs[1].iov_base = &file_metadata_length;
+  iovecs[1].iov_len = sizeof(file_metadata_length);
+  iovecs[2].iov_base = const_cast<char*>(kParquetMagicBytes);
+  iovecs[2].iov_len = strlen(kParquetMagicBytes);
+  uint64_t footer_offset = sink_->Tell();
+  LOG_IF(FATAL, !sink_->Write(iovecs)) << "Could not write the footer";
+  VLOG(2) << "Footer written at offset " << footer_offset;
 }
 
 void ParquetFile::SetSchema(ParquetColumn* root) {
@@ -200,6 +762,19 @@ void ParquetFile::SetSchema(ParquetColumn* root) {
   VLOG(2) << root->ToString();
 
   file_meta_data_.__set_schema(parquet_schema_vector);
+
+  shard_columns_.clear();
+  shard_file_columns_.assign(2 * shards_.size(), vector<ParquetColumn*>());
+  shard_filling_column_set_.assign(shards_.size(), 0);
+  for (int i = 0; i < shards_.size(); ++i) {
+    vector<ParquetColumn*>* columns =
+        &shard_file_columns_[ShardColumnSet(i, 0)];
+    shards_[i]->SetSchema(CloneSchema(root, columns));
+    CloneSchema(root, &shard_file_columns_[ShardColumnSet(i, 1)]);
+  }
+  if (!shards_.empty()) {
+    RouteRecordsToShards();
+  }
 }
 
 const ParquetColumn* ParquetFile::Root() const {
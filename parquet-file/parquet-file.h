@@ -4,10 +4,13 @@
 
 #include <fcntl.h>
 #include <glog/logging.h>
+#include <parquet-file/async-writer.h>
 #include <parquet-file/parquet-column.h>
-#include <thrift/protocol/TCompactProtocol.h>
-#include <thrift/transport/TFDTransport.h>
+#include <parquet-file/parquet-sink.h>
+#include <parquet-file/positioned-writer.h>
+#include <parquet-file/worker-pool.h>
 
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -15,34 +18,98 @@
 #ifndef PARQUET_FILE_PARQUET_FILE_H_
 #define PARQUET_FILE_PARQUET_FILE_H_
 
-using apache::thrift::transport::TFDTransport;
-using apache::thrift::protocol::TCompactProtocol;
 using parquet::CompressionCodec;
 using parquet::FileMetaData;
+using parquet::RowGroup;
 using parquet::SchemaElement;
 using std::function;
 using std::set;
 using std::string;
 using std::vector;
 
-const uint32_t kDataBytesPerPage = 81920000;
-
 namespace parquet_file {
 const int kMaxDataBytesPerRowGroup = 1024000;
 
+// How records are assigned to files when a ParquetFile writes more
+// than one file.
+enum ShardingPolicy {
+  // Records go to each file in turn.
+  ROUND_ROBIN,
+  // Records go to the file picked by a hash of the data in a key
+  // column, so records with the same key end up in the same file.
+  // Each record's key has to be added before the rest of the record.
+  HASH_KEY_COLUMN,
+};
+
 // Main class that represents a Parquet file on disk.
 class ParquetFile {
  public:
-  // Constructor.  file_base is the output file. The num_files is a
-  // sharding parameter, but currently isn't supported.
+  // Constructor.  file_base is the output file.  If num_files is
+  // greater than one, records are instead sharded across num_files
+  // files named by ShardFileName(), each a standalone Parquet file
+  // with its own footer, written on its own thread.  Records then go
+  // straight from the schema's columns to the file they belong in as
+  // they're added.  Each file buffers up to two row groups: records go
+  // into one while its thread writes the other.
   ParquetFile(string file_base, int num_files = 1);
 
+  // Writes a single Parquet file to sink, which must outlive this
+  // object.  Flush() closes the sink.
+  explicit ParquetFile(ParquetSink* sink);
+
+  // Returns the name of file shard_index of num_files written for
+  // file_base, e.g. "file_base-00001-of-00004".
+  static string ShardFileName(const string& file_base, int shard_index,
+                              int num_files);
+
+  // Sets how records are assigned to files when writing more than
+  // one.  For HASH_KEY_COLUMN, key_column_path is the FullSchemaPath()
+  // of the leaf column whose data is hashed.  Must be called after
+  // SetSchema.  Defaults to ROUND_ROBIN.
+  void SetShardingPolicy(ShardingPolicy policy,
+                         const string& key_column_path = "");
+
+  // Number of files this ParquetFile writes.
+  int NumberOfFiles() const { return num_files_; }
+
   // Set the schema of this file.
   void SetSchema(ParquetColumn* root);
   // Return the root of the schema.
   const ParquetColumn* Root() const;
 
-  // Flush the file to the filename given in the constructor.
+  // Sets the amount of buffered column data, in bytes, after which
+  // MaybeFlushRowGroup() writes out a row group.  Defaults to
+  // kMaxDataBytesPerRowGroup.
+  void SetRowGroupSizeInBytes(uint64_t row_group_size_in_bytes);
+
+  // Writes the data buffered in the columns as a row group, and
+  // resets the columns, if the buffered data has reached the row group
+  // size.  Call this between records (i.e. when every column has the
+  // same number of records) to bound memory use by the size of one
+  // row group rather than the size of the file.  Returns true if a row
+  // group was written.  When writing more than one file, every file
+  // that has buffered the row group size instead starts writing a row
+  // group on its writer thread; returns true if any did.
+  bool MaybeFlushRowGroup();
+
+  // Sets the number of threads used to encode and compress column
+  // chunks when a row group is written.  Defaults to the number of
+  // cores.  The threads are started once and kept until this object
+  // is destroyed.
+  void SetNumEncodingThreads(int num_encoding_threads);
+
+  // Writes row groups asynchronously: each one is copied into one of
+  // num_buffers output buffers and queued, with up to queue_depth
+  // writes in flight, so the next row group can be buffered and
+  // encoded while the last is still being written.  Uses io_uring if
+  // available, and background writer threads otherwise.  Flush()
+  // waits for all writes to finish before writing the footer.  Must be
+  // called before the first row group is written.
+  void SetAsyncOutput(int num_buffers = kDefaultAsyncOutputBuffers,
+                      int queue_depth = kDefaultAsyncQueueDepth);
+
+  // Flush any buffered data as a final row group, followed by the
+  // file footer, to the filename given in the constructor.
   void Flush();
   // Close the file.
   void Close();
@@ -50,12 +117,20 @@ class ParquetFile {
 
   uint64_t NumberOfRecords() const;
 
-  // Calculates the number of rowgroups for the data in this Parquet
-  // file.  It isn't quite correct because it only looks at data, not
-  // the encoded R&D levels, but this will be rectified later.
+  // Calculates the number of full row groups the buffered data would
+  // make, using each column's estimate of its encoded data & levels.
+  // Takes O(row groups * log(records) * columns) time.
   uint32_t CalculateNumberOfRowGroups() const;
 
   uint64_t BytesForRecord(uint64_t record_index) const;
+
+  // Number of row groups written to the file (or all files) so far.
+  // When writing more than one file, only exact after Flush().
+  uint32_t NumberOfRowGroupsWritten() const;
+
+  // Number of records written to file file_index so far.  When
+  // writing more than one file, only exact after Flush().
+  uint64_t NumberOfRecordsWrittenToFile(int file_index) const;
  private:
   // Walker for the schema.  Parquet requires columns specified as a
   // vector that is the depth first preorder traversal of the schema,
@@ -68,21 +143,165 @@ class ParquetFile {
   // data-containing columns.
   void NumberOfRecords(set<uint64_t>* column_record_counts) const;
 
+  // Estimated total bytes of data and levels buffered in all
+  // data-containing columns.
+  uint64_t BufferedDataSizeInBytes() const;
+  // Same, for the columns of file_columns, a depth first traversal of
+  // a schema.
+  static uint64_t BufferedDataSizeInBytes(
+      const vector<ParquetColumn*>& file_columns);
+
+  // Writes the data currently buffered in the columns to the file as
+  // a row group, and adds its metadata to file_meta_data_.  Does not
+  // reset the columns.
+  void FlushRowGroup();
+
+  // Writes the page indexes of every column chunk after the last row
+  // group, and points the chunks' metadata at them.
+  void WritePageIndexes();
+
+  // Writes the file footer (metadata, its length and the magic
+  // bytes) after the last row group.
+  void WriteFooter();
+
+  // Writes the magic header and sets up the file metadata.
+  void StartFile();
+
+  // Starts encoding_pool_ with num_encoding_threads_ threads,
+  // replacing any pool already running.
+  void StartEncodingPool();
+
+  // Discards the data buffered in all data-containing columns.
+  void ResetColumns();
+
+  // Fills leaf_columns with the data-containing columns, in schema
+  // order.
+  void LeafColumns(vector<ParquetColumn*>* leaf_columns) const;
+  // Same, for the columns of file_columns, a depth first traversal of
+  // a schema.
+  static void LeafColumns(const vector<ParquetColumn*>& file_columns,
+                          vector<ParquetColumn*>* leaf_columns);
+
+  // Makes a copy of the schema rooted at column, without any data,
+  // for one of the shards, and appends its columns to clone_columns
+  // in depth first order.  The copies are owned by shard_columns_.
+  ParquetColumn* CloneSchema(const ParquetColumn* column,
+                             vector<ParquetColumn*>* clone_columns);
+
+  // Index in shard_file_columns_ of copy column_set (0 or 1) of the
+  // schema of shard.
+  static int ShardColumnSet(int shard, int column_set) {
+    return 2 * shard + column_set;
+  }
+
+  // Routes the records added to each leaf column straight to the
+  // shards' copies of it.
+  void RouteRecordsToShards();
+
+  // Returns the ShardColumnSet() that record record_index of leaf
+  // column column_index goes to: the one of its shard, under the
+  // current sharding policy, that records are being added to.  data
+  // is the record's data (nullptr for a null).
+  int ShardForRecord(int column_index, uint64_t record_index,
+                     const uint8_t* data, size_t length);
+
+  // Waits for the writer thread of shard to go idle.
+  void WaitForShard(int shard);
+
+  // Between records, has every shard that has buffered the row group
+  // size write a row group on its writer thread, and switches its
+  // records to the shard's other copy of the schema.  Only waits for
+  // a shard's writer if it's still writing that copy.  Returns true if
+  // any shard started a row group.
+  bool FlushFullShards();
+
+  // Calls callback with the index of each of columns, on up to
+  // num_encoding_threads_ threads of encoding_pool_.
+  void ForEachColumnInParallel(const vector<ParquetColumn*>& columns,
+                               const function<void(size_t)>& callback);
+
+  // Encodes the column chunks of the given columns in parallel, on up
+  // to num_encoding_threads_ threads.
+  void EncodeColumnChunks(const vector<ParquetColumn*>& columns);
+
+  // Writes the encoded column chunks of the given columns, column c at
+  // column_offsets[c], into the row group reserved at
+  // row_group_offset.  Chunks are queued to async_writer_ if there is
+  // one, and otherwise written in parallel when there's more than one
+  // encoding thread.
+  void WriteColumnChunks(const vector<ParquetColumn*>& columns,
+                         off_t row_group_offset,
+                         const vector<off_t>& column_offsets);
+
+  // Writes the Bloom filters of the columns that have one right after
+  // their row group, and sets bloom_filter_offset in the metadata of
+  // the matching column_chunks.
+  void WriteBloomFilters(const vector<ParquetColumn*>& columns,
+                         vector<ColumnChunk>* column_chunks);
+
   // A vector representing the DFS traversal of the columns.
   vector<ParquetColumn*> file_columns_;
 
   // Parquet Thrift structure that has metadata about the entire file.
   FileMetaData file_meta_data_;
 
+  // Row groups that have been written to the file so far.
+  vector<RowGroup> row_groups_;
+  // Page indexes of the column chunks of row_groups_, indexed the same
+  // way, held until they're written before the footer.  A column
+  // index with no pages stands for a chunk without one.
+  vector<vector<parquet::ColumnIndex>> column_indexes_;
+  vector<vector<parquet::OffsetIndex>> offset_indexes_;
+  // Total number of records in the row groups written so far.
+  uint64_t num_rows_written_;
+  // Buffered data size at which MaybeFlushRowGroup writes a row group.
+  uint64_t row_group_size_in_bytes_;
+  // Number of threads used to encode column chunks.
+  int num_encoding_threads_;
+  // Threads that encode and write column chunks, if there's more than
+  // one encoding thread.  Not used when this object only hands out
+  // records to shards_.
+  std::unique_ptr<WorkerPool> encoding_pool_;
+
   // Variables that represent file system location and data.
   string file_base_;
   int num_files_;
-  int fd_;
+  // Where the file is written, and the sink we created for it, if
+  // any.
+  ParquetSink* sink_;
+  std::unique_ptr<ParquetSink> owned_sink_;
+  // Queues row group writes to sink_'s PositionedWriter, if
+  // SetAsyncOutput was called.
+  std::unique_ptr<AsyncWriter> async_writer_;
 
-  // Member variables used to actually encode & write the data to
-  // disk.
-  std::shared_ptr<TFDTransport> file_transport_;
-  std::shared_ptr<TCompactProtocol> protocol_;
+  // When writing more than one file, one ParquetFile per output file.
+  // This object then just routes records to them.
+  vector<std::unique_ptr<ParquetFile>> shards_;
+  // Schema copies used by the shards.
+  vector<std::unique_ptr<ParquetColumn>> shard_columns_;
+  // Each shard has two copies of the schema, so records can be added
+  // to one while the shard's writer writes a row group from the
+  // other.  The depth first traversal of each, indexed by
+  // ShardColumnSet().
+  vector<vector<ParquetColumn*>> shard_file_columns_;
+  // Which copy of each shard's schema records are being added to.
+  vector<int> shard_filling_column_set_;
+  // One thread per shard, fed through its queue, that writes the
+  // shard's row groups and footer.  Declared after shards_ so they're
+  // joined before the shards go away.
+  vector<std::unique_ptr<WorkerPool>> shard_writers_;
+  // Whether each shard's writer may still be busy with the copy of
+  // its schema records aren't going to, i.e. hasn't been waited for
+  // since it was last given work.
+  vector<bool> shard_writing_;
+  ShardingPolicy sharding_policy_;
+  // Index among the leaf columns of the HASH_KEY_COLUMN key column.
+  int shard_key_column_index_;
+  // Under HASH_KEY_COLUMN, the shard of each record whose key has
+  // been added but whose other columns may not have been, starting
+  // with record first_record_shard_.
+  vector<int> record_shards_;
+  uint64_t first_record_shard_;
 
   // A bit indicating that we've initialized OK, defined the schema,
   // and are ready to start accepting & writing data.
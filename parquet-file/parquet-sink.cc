@@ -0,0 +1,137 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./parquet-sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <parquet-file/chunked-buffer.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace parquet_file {
+
+bool ParquetSink::Write(const void* data, size_t length) {
+  vector<struct iovec> iovecs(1);
+  iovecs[0].iov_base = const_cast<void*>(data);
+  iovecs[0].iov_len = length;
+  return Write(iovecs);
+}
+
+FileSink::FileSink(const string& filename)
+  : owns_fd_(true) {
+  fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL, 0700);
+  LOG_IF(FATAL, fd_ == -1) << "Could not create file " << filename
+                           << ": " << strerror(errno);
+  writer_.reset(new PositionedWriter(fd_, 0));
+}
+
+FileSink::FileSink(int fd)
+  : fd_(fd),
+    owns_fd_(false) {
+  off_t start_offset = lseek(fd, 0, SEEK_CUR);
+  LOG_IF(FATAL, start_offset == -1 && errno == ESPIPE)
+      << "fd " << fd << " can't seek; write to it with a StreamSink";
+  LOG_IF(FATAL, start_offset == -1) << "Could not find the offset of fd "
+                                    << fd << ": " << strerror(errno);
+  writer_.reset(new PositionedWriter(fd_, start_offset));
+}
+
+FileSink::~FileSink() {
+  if (owns_fd_ && fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool FileSink::Write(const vector<struct iovec>& iovecs) {
+  size_t length = 0;
+  for (const struct iovec& iov : iovecs) {
+    length += iov.iov_len;
+  }
+  vector<struct iovec> unwritten(iovecs);
+  return writer_->WriteAt(writer_->Reserve(length), &unwritten) == length;
+}
+
+uint64_t FileSink::Tell() const {
+  return writer_->Size();
+}
+
+bool FileSink::Flush() {
+  // Writes go straight to the file; there's nothing held back.
+  return true;
+}
+
+bool FileSink::Close() {
+  if (!owns_fd_ || fd_ == -1) {
+    return true;
+  }
+  int ret = close(fd_);
+  fd_ = -1;
+  LOG_IF(ERROR, ret == -1) << "close failed: " << strerror(errno);
+  return ret == 0;
+}
+
+StreamSink::StreamSink(int fd)
+  : fd_(fd),
+    bytes_written_(0) {
+  CHECK_GE(fd, 0) << "Invalid file descriptor";
+}
+
+bool StreamSink::Write(const vector<struct iovec>& iovecs) {
+  size_t length = 0;
+  for (const struct iovec& iov : iovecs) {
+    length += iov.iov_len;
+  }
+  vector<struct iovec> unwritten(iovecs);
+  ssize_t written = WriteIovecs(fd_, &unwritten);
+  if (written != length) {
+    return false;
+  }
+  bytes_written_ += length;
+  return true;
+}
+
+MemorySink::MemorySink() {
+}
+
+bool MemorySink::Write(const vector<struct iovec>& iovecs) {
+  for (const struct iovec& iov : iovecs) {
+    const uint8_t* data = static_cast<const uint8_t*>(iov.iov_base);
+    contents_.insert(contents_.end(), data, data + iov.iov_len);
+  }
+  return true;
+}
+
+void MemorySink::TakeContents(vector<uint8_t>* contents) {
+  CHECK_NOTNULL(contents);
+  contents->clear();
+  contents->swap(contents_);
+}
+
+CallbackSink::CallbackSink(const WriteCallback& write_callback,
+                           const function<bool()>& close_callback)
+  : write_callback_(write_callback),
+    close_callback_(close_callback),
+    bytes_written_(0) {
+  CHECK(write_callback) << "CallbackSink needs a write callback";
+}
+
+bool CallbackSink::Write(const vector<struct iovec>& iovecs) {
+  for (const struct iovec& iov : iovecs) {
+    if (!write_callback_(static_cast<const uint8_t*>(iov.iov_base),
+                         iov.iov_len)) {
+      return false;
+    }
+    bytes_written_ += iov.iov_len;
+  }
+  return true;
+}
+
+bool CallbackSink::Close() {
+  if (close_callback_) {
+    return close_callback_();
+  }
+  return true;
+}
+
+}  // namespace parquet_file
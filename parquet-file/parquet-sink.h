@@ -0,0 +1,145 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <parquet-file/positioned-writer.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef PARQUET_FILE_PARQUET_SINK_H_
+#define PARQUET_FILE_PARQUET_SINK_H_
+
+using std::function;
+using std::string;
+using std::vector;
+
+namespace parquet_file {
+
+// ParquetSink is where a ParquetFile's bytes go.  Data is appended
+// with Write(), and Tell() gives the offset the next write lands at,
+// which is what the file's metadata records.  Methods return false on
+// error.
+class ParquetSink {
+ public:
+  virtual ~ParquetSink() {}
+
+  // Appends the data in iovecs.
+  virtual bool Write(const vector<struct iovec>& iovecs) = 0;
+
+  // Appends length bytes starting at data.
+  bool Write(const void* data, size_t length);
+
+  // Number of bytes written so far, i.e. the offset of the next
+  // write.
+  virtual uint64_t Tell() const = 0;
+
+  // Pushes any data the sink is holding on to to its destination.
+  virtual bool Flush() = 0;
+
+  // Flushes, and releases whatever the sink writes to.  Nothing can
+  // be written afterwards.
+  virtual bool Close() = 0;
+
+  // Returns a writer that can write anywhere in the sink, from
+  // several threads at once, or nullptr if the sink can only be
+  // appended to.  Writes through the PositionedWriter must reserve
+  // their range from it; Tell() accounts for them.
+  virtual PositionedWriter* GetPositionedWriter() { return nullptr; }
+};
+
+// Writes to a file descriptor with pwritev, at offsets tracked by a
+// PositionedWriter, so it supports positioned writes.
+class FileSink : public ParquetSink {
+ public:
+  // Creates filename, which must not exist yet.  Dies if it can't be
+  // created.
+  explicit FileSink(const string& filename);
+  // Writes to fd, which is already open, starting at its current
+  // offset, where the Parquet file then starts: Tell() and the offsets
+  // of the positioned writer are relative to it.  fd must be seekable;
+  // use StreamSink for pipes and sockets.  fd stays open after Close().
+  explicit FileSink(int fd);
+  ~FileSink();
+
+  bool Write(const vector<struct iovec>& iovecs) override;
+  uint64_t Tell() const override;
+  bool Flush() override;
+  bool Close() override;
+  PositionedWriter* GetPositionedWriter() override { return writer_.get(); }
+
+ private:
+  int fd_;
+  // Whether we opened fd_, and so close it.
+  bool owns_fd_;
+  std::unique_ptr<PositionedWriter> writer_;
+};
+
+// Writes to a file descriptor that can't seek, like a pipe, a socket
+// or stdout, with writev.  Offsets come from a count of the bytes
+// written, so the Parquet file is taken to start where the sink
+// starts writing.  fd should be in blocking mode.  It stays open after
+// Close().
+class StreamSink : public ParquetSink {
+ public:
+  explicit StreamSink(int fd);
+
+  bool Write(const vector<struct iovec>& iovecs) override;
+  uint64_t Tell() const override { return bytes_written_; }
+  bool Flush() override { return true; }
+  bool Close() override { return true; }
+
+ private:
+  int fd_;
+  uint64_t bytes_written_;
+};
+
+// Accumulates the file in a growable buffer in memory, e.g. to send
+// it somewhere without going through the file system.
+class MemorySink : public ParquetSink {
+ public:
+  MemorySink();
+
+  bool Write(const vector<struct iovec>& iovecs) override;
+  uint64_t Tell() const override { return contents_.size(); }
+  bool Flush() override { return true; }
+  bool Close() override { return true; }
+
+  // The bytes written so far.
+  const vector<uint8_t>& Contents() const { return contents_; }
+
+  // Moves the bytes written so far into contents, without copying
+  // them, and empties the sink.
+  void TakeContents(vector<uint8_t>* contents);
+
+ private:
+  vector<uint8_t> contents_;
+};
+
+// Hands every write to a function provided by the user, which
+// returns false if the data couldn't be written.  Data passed to the
+// function is only valid for the duration of the call.
+class CallbackSink : public ParquetSink {
+ public:
+  typedef function<bool(const uint8_t* data, size_t length)> WriteCallback;
+
+  // close_callback, if given, is called by Close().
+  explicit CallbackSink(const WriteCallback& write_callback,
+                        const function<bool()>& close_callback = nullptr);
+
+  bool Write(const vector<struct iovec>& iovecs) override;
+  uint64_t Tell() const override { return bytes_written_; }
+  bool Flush() override { return true; }
+  bool Close() override;
+
+ private:
+  WriteCallback write_callback_;
+  function<bool()> close_callback_;
+  uint64_t bytes_written_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_PARQUET_SINK_H_
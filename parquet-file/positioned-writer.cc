@@ -0,0 +1,58 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./positioned-writer.h"
+
+#include <errno.h>
+#include <glog/logging.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace parquet_file {
+
+PositionedWriter::PositionedWriter(int fd, off_t start_offset)
+  : fd_(fd),
+    start_offset_(start_offset),
+    end_offset_(0) {
+  CHECK_GE(fd, 0) << "Invalid file descriptor";
+  CHECK_GE(start_offset, 0) << "Invalid start offset";
+}
+
+off_t PositionedWriter::Reserve(size_t length) {
+  return end_offset_.fetch_add(length);
+}
+
+ssize_t PositionedWriter::WriteAt(off_t offset, vector<struct iovec>* iovecs) {
+  CHECK_NOTNULL(iovecs);
+  size_t total_written = 0;
+  size_t first = 0;
+  while (first < iovecs->size()) {
+    int count = std::min<size_t>(iovecs->size() - first, IOV_MAX);
+    ssize_t written = pwritev(fd_, &(*iovecs)[first], count,
+                              start_offset_ + offset + total_written);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(ERROR) << "pwritev failed: " << strerror(errno);
+      return -1;
+    }
+    total_written += written;
+    // Skip past the iovecs that were written completely, and adjust
+    // the first one that was only partially written.
+    while (first < iovecs->size() && written >= (*iovecs)[first].iov_len) {
+      written -= (*iovecs)[first].iov_len;
+      ++first;
+    }
+    if (written > 0) {
+      struct iovec& partial = (*iovecs)[first];
+      partial.iov_base = (uint8_t*)partial.iov_base + written;
+      partial.iov_len -= written;
+    }
+  }
+  return total_written;
+}
+
+}  // namespace parquet_file
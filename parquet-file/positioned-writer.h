@@ -0,0 +1,55 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <vector>
+
+#ifndef PARQUET_FILE_POSITIONED_WRITER_H_
+#define PARQUET_FILE_POSITIONED_WRITER_H_
+
+using std::vector;
+
+namespace parquet_file {
+
+// PositionedWriter writes to a file at offsets it keeps track of
+// itself, rather than at the file position of the descriptor.  Space
+// is reserved up front with Reserve(), which hands out consecutive,
+// non-overlapping ranges, and then filled in with WriteAt(), which
+// uses pwritev.  Both are safe to call from several threads at once,
+// so different threads can write different column chunks or row
+// groups at the same time while every offset stays exact.
+class PositionedWriter {
+ public:
+  // Writes to fd, after its first start_offset bytes, which are left
+  // alone.  Offsets given to and returned by the writer are relative
+  // to start_offset, so they're offsets into what's written through
+  // it, e.g. a Parquet file that starts part way into fd.
+  PositionedWriter(int fd, off_t start_offset);
+
+  // Reserves the next length bytes of the file and returns the
+  // offset they start at.
+  off_t Reserve(size_t length);
+
+  // Writes iovecs to the file starting at offset, calling pwritev as
+  // many times as it takes.  iovecs is modified along the way.
+  // Returns the number of bytes written, or -1 on error.
+  ssize_t WriteAt(off_t offset, vector<struct iovec>* iovecs);
+
+  // Offset just past the last reserved range.
+  off_t Size() const { return end_offset_; }
+
+  int fd() const { return fd_; }
+  // Offset in fd that offset 0 of the writer is at.
+  off_t StartOffset() const { return start_offset_; }
+
+ private:
+  int fd_;
+  off_t start_offset_;
+  std::atomic<off_t> end_offset_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_POSITIONED_WRITER_H_
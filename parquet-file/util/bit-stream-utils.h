@@ -60,6 +60,12 @@ class BitWriter {
   template<typename T>
   bool PutAligned(T v, int num_bits);
 
+  // Bit packs num_values values of num_bits bits each (num_bits <= 64), starting at
+  // the next aligned byte, least significant bit first.  num_values must be a
+  // multiple of 8, so the values end on a byte boundary.  Each width has its own
+  // unrolled kernel.  Returns false if there was not enough space.
+  bool PutPackedValues(const uint64_t* values, int num_values, int num_bits);
+
   // Write a Vlq encoded int to the buffer.  Returns false if there was not enough
   // room.  The value is written byte aligned.
   // For more details on vlq:
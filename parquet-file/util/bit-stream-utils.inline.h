@@ -90,6 +90,70 @@ inline uint8_t* BitWriter::GetNextBytePtr(int num_bytes) {
   return ptr;
 }
 
+// Bit packs num_values values (a multiple of 8) of NUM_BITS bits each into out.
+// Every 8 values take exactly NUM_BITS bytes, so with NUM_BITS known at compile
+// time the inner loop unrolls into straight-line shifts and stores.
+template<int NUM_BITS>
+inline void PackValues(const uint64_t* values, int num_values, uint8_t* out) {
+  for (int i = 0; i < num_values; i += 8) {
+    // Bits not yet stored; fewer than 8 between values.
+    uint64_t buffered = 0;
+    int num_buffered = 0;
+    for (int j = 0; j < 8; ++j) {
+      uint64_t v = values[i + j];
+      buffered |= v << num_buffered;
+      int total = num_buffered + NUM_BITS;
+      if (total >= 64) {
+        memcpy(out, &buffered, 8);
+        out += 8;
+        // The high bits of v that didn't fit in buffered.
+        buffered = num_buffered == 0 ? 0 : v >> (64 - num_buffered);
+        num_buffered = total - 64;
+      } else {
+        int num_bytes = total / 8;
+        memcpy(out, &buffered, num_bytes);
+        out += num_bytes;
+        buffered >>= num_bytes * 8;
+        num_buffered = total % 8;
+      }
+    }
+  }
+}
+
+typedef void (*PackValuesFunction)(const uint64_t*, int, uint8_t*);
+
+// Fills table[0..NUM_BITS] with the PackValues kernel for each width.
+template<int NUM_BITS>
+struct PackValuesTable {
+  static void Fill(PackValuesFunction* table) {
+    table[NUM_BITS] = PackValues<NUM_BITS>;
+    PackValuesTable<NUM_BITS - 1>::Fill(table);
+  }
+};
+
+template<>
+struct PackValuesTable<-1> {
+  static void Fill(PackValuesFunction* table) {}
+};
+
+inline PackValuesFunction GetPackValuesFunction(int num_bits) {
+  static PackValuesFunction table[65];
+  static bool filled = (PackValuesTable<64>::Fill(table), true);
+  (void)filled;
+  return table[num_bits];
+}
+
+inline bool BitWriter::PutPackedValues(const uint64_t* values, int num_values,
+                                       int num_bits) {
+  DCHECK_GE(num_bits, 0);
+  DCHECK_LE(num_bits, 64);
+  DCHECK_EQ(num_values % 8, 0);
+  uint8_t* ptr = GetNextBytePtr(num_values / 8 * num_bits);
+  if (ptr == NULL) return false;
+  if (num_bits > 0) GetPackValuesFunction(num_bits)(values, num_values, ptr);
+  return true;
+}
+
 template<typename T>
 inline bool BitWriter::PutAligned(T val, int num_bytes) {
   uint8_t* ptr = GetNextBytePtr(num_bytes);
@@ -118,7 +118,7 @@ class RleEncoder {
   // based on the bit_width, which can determine a storage optimal choice.
   // TODO: allow 0 bit_width (and have dict encoder use it)
   RleEncoder(uint8_t* buffer, int buffer_len, int max_value)
-    : bit_width_(Log2(max_value) + 1),
+    : bit_width_(BitWidth(max_value)),
       bit_writer_(buffer, buffer_len) {
     DCHECK_GE(bit_width_, 1);
     DCHECK_LE(bit_width_, 64);
@@ -128,11 +128,18 @@ class RleEncoder {
     Clear();
   }
 
+  // Returns the number of bits needed to represent every value from 0 to
+  // 'max_value', which is the bit width the encoder uses.  Parquet levels
+  // are encoded with this width for the column's max level.
+  static int BitWidth(uint64_t max_value) {
+    return max_value == 0 ? 1 : Log2(max_value + 1);
+  }
+
   // Returns the minimum buffer size needed to use the encoder for 'bit_width'
   // This is the maximum length of a single run for 'bit_width'.
   // It is not valid to pass a buffer less than this length.
   static int MinBufferSize(int max_value) {
-    int bit_width = Log2(max_value) + 1;
+    int bit_width = BitWidth(max_value);
     // 1 indicator byte and MAX_VALUES_PER_LITERAL_RUN 'bit_width' values.
     int max_literal_run_size = 1 +
         Ceil(MAX_VALUES_PER_LITERAL_RUN * bit_width, 8);
@@ -143,11 +150,11 @@ class RleEncoder {
 
   // Returns the maximum byte size it could take to encode 'num_values'.
   static int MaxBufferSize(int num_values, int max_value) {
-    int bit_width = Log2(max_value) + 1;
+    int bit_width = BitWidth(max_value);
     int bytes_per_run = Ceil(bit_width * MAX_VALUES_PER_LITERAL_RUN, 8.0);
     int num_runs = Ceil(num_values, MAX_VALUES_PER_LITERAL_RUN);
     int literal_max_size = num_runs + num_runs * bytes_per_run;
-    int min_run_size = MinBufferSize(bit_width);
+    int min_run_size = MinBufferSize(max_value);
     return std::max(min_run_size, literal_max_size) + min_run_size;
   }
 
@@ -155,6 +162,19 @@ class RleEncoder {
   // This value must be representable with bit_width_ bits.
   bool Put(uint64_t value);
 
+  // Encode 'count' copies of value.  Equivalent to calling Put(value) 'count'
+  // times, but once the values are part of a repeated run the rest of them are
+  // added in constant time.
+  bool PutRun(uint64_t value, uint64_t count);
+
+  // Encode the 'num_values' values starting at 'values'.  Equivalent to calling
+  // Put() for each of them, but runs within the batch go through PutRun().
+  template<typename T>
+  bool PutBatch(const T* values, int64_t num_values);
+
+  // Number of bits each value is encoded with.
+  int bit_width() const { return bit_width_; }
+
   // Flushes any pending values to the underlying buffer.
   // Returns the total number of bytes written
   int Flush();
@@ -192,6 +212,14 @@ class RleEncoder {
   // (number of groups encodable by a 1-byte indicator * 8)
   static const int MAX_VALUES_PER_LITERAL_RUN = (1 << 6) * 8;
 
+  // The maximum number of values in a single repeated run (the count is
+  // shifted left by one in the 32-bit indicator).
+  static const int MAX_VALUES_PER_REPEATED_RUN = (1 << 30) - 1;
+
+  // Runs at least this long are handed to PutRun() by PutBatch().  Shorter
+  // ones are cheaper to Put() one at a time.
+  static const int MIN_BATCH_RUN_LENGTH = 16;
+
   // Number of bits needed to encode the value.
   const int bit_width_;
 
@@ -297,6 +325,51 @@ inline bool RleEncoder::Put(uint64_t value) {
   return true;
 }
 
+inline bool RleEncoder::PutRun(uint64_t value, uint64_t count) {
+  while (count > 0) {
+    // Once a full group of 8 identical values has been seen, the encoder is in a
+    // repeated run with nothing buffered, and Put() only increments
+    // repeat_count_.  Getting there takes at most two groups of Put()s.
+    if (current_value_ != value || repeat_count_ < 8) {
+      if (!Put(value)) return false;
+      --count;
+      continue;
+    }
+    if (UNLIKELY(buffer_full_)) return false;
+    DCHECK_EQ(num_buffered_values_, 0);
+    uint64_t room = MAX_VALUES_PER_REPEATED_RUN - repeat_count_;
+    if (count <= room) {
+      repeat_count_ += count;
+      return true;
+    }
+    // The run is longer than an indicator can express; end it and let the
+    // rest start a new one.
+    repeat_count_ = MAX_VALUES_PER_REPEATED_RUN;
+    count -= room;
+    FlushRepeatedRun();
+  }
+  return true;
+}
+
+template<typename T>
+inline bool RleEncoder::PutBatch(const T* values, int64_t num_values) {
+  int64_t i = 0;
+  while (i < num_values) {
+    int64_t run_end = i + 1;
+    while (run_end < num_values && values[run_end] == values[i]) ++run_end;
+    int64_t run_length = run_end - i;
+    if (run_length >= MIN_BATCH_RUN_LENGTH) {
+      if (!PutRun(values[i], run_length)) return false;
+    } else {
+      for (int64_t j = 0; j < run_length; ++j) {
+        if (!Put(values[i])) return false;
+      }
+    }
+    i = run_end;
+  }
+  return true;
+}
+
 inline void RleEncoder::FlushLiteralRun(bool update_indicator_byte) {
   if (literal_indicator_byte_ == NULL) {
     // The literal indicator byte has not been reserved yet, get one now.
@@ -0,0 +1,82 @@
+// Copyright 2014 Mount Sinai School of Medicine.
+
+#include "./worker-pool.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace parquet_file {
+
+WorkerPool::WorkerPool(int num_threads)
+  : num_pending_tasks_(0),
+    shutting_down_(false) {
+  CHECK_GT(num_threads, 0) << "Need at least one worker thread";
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(std::thread(&WorkerPool::WorkerThread, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  task_queued_.notify_all();
+  for (std::thread& t : threads_) {
+    t.join();
+  }
+}
+
+void WorkerPool::Post(const function<void()>& task) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_.push_back(task);
+    ++num_pending_tasks_;
+  }
+  task_queued_.notify_one();
+}
+
+void WorkerPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_done_.wait(lock, [this] () { return num_pending_tasks_ == 0; });
+}
+
+void WorkerPool::ForEach(size_t n, const function<void(size_t)>& callback) {
+  std::atomic<size_t> next(0);
+  int num_tasks = std::min<size_t>(threads_.size(), n);
+  for (int i = 0; i < num_tasks; ++i) {
+    Post([n, &next, &callback] () {
+        for (size_t index = next++; index < n; index = next++) {
+          callback(index);
+        }
+      });
+  }
+  Wait();
+}
+
+void WorkerPool::WorkerThread() {
+  for (;;) {
+    function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_queued_.wait(lock, [this] () {
+          return shutting_down_ || !tasks_.empty();
+        });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+    task();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      --num_pending_tasks_;
+    }
+    task_done_.notify_all();
+  }
+}
+
+}  // namespace parquet_file
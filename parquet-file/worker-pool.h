@@ -0,0 +1,59 @@
+// Copyright 2014 Mount Sinai School of Medicine
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef PARQUET_FILE_WORKER_POOL_H_
+#define PARQUET_FILE_WORKER_POOL_H_
+
+using std::function;
+using std::vector;
+
+namespace parquet_file {
+
+// A fixed set of threads that run tasks from a queue, in the order
+// they're posted, for as long as the pool lives.  Tasks are posted
+// and waited for from one thread.
+class WorkerPool {
+ public:
+  explicit WorkerPool(int num_threads);
+  // Runs the tasks still queued, then joins the threads.
+  ~WorkerPool();
+
+  int NumThreads() const { return threads_.size(); }
+
+  // Queues task to run on one of the threads.
+  void Post(const function<void()>& task);
+
+  // Waits for every task posted so far to finish.
+  void Wait();
+
+  // Calls callback with each index below n, on up to NumThreads()
+  // threads, and waits for all the calls to finish.  Each thread takes
+  // the next index until there are none left, so a few slow calls
+  // don't hold up the rest.
+  void ForEach(size_t n, const function<void(size_t)>& callback);
+
+ private:
+  // Loop run by each thread.
+  void WorkerThread();
+
+  std::mutex mutex_;
+  std::condition_variable task_queued_;
+  std::condition_variable task_done_;
+  std::deque<function<void()>> tasks_;
+  // Tasks queued or running.
+  int num_pending_tasks_;
+  bool shutting_down_;
+  vector<std::thread> threads_;
+};
+
+}  // namespace parquet_file
+
+#endif  // PARQUET_FILE_WORKER_POOL_H_